@@ -14,6 +14,8 @@ static inline void print_usage() {
   fprintf(stderr, "Contact: Haowen Zhang <hwzhang@gatech.edu>\n\n");
   fprintf(stderr, "Usage:   FEM <command> [options]\n\n");
   fprintf(stderr, "Command: index   build index for reference\n");
+  fprintf(stderr, "         index-merge  merge two indexes\n");
+  fprintf(stderr, "         index-stats  report bucket sizes and memory of an index\n");
   fprintf(stderr, "         map     map reads\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Note: To use FEM, you need to first index the genome with `FEM index'.\n\n");
@@ -32,6 +34,10 @@ int main(int argc, char *argv[]) {
   double cpu_start_time = get_cpu_time();
   if (strcmp(argv[1], "index") == 0) {
     return_value = index_main(argc - 1, argv + 1);
+  } else if (strcmp(argv[1], "index-merge") == 0) {
+    return_value = index_merge_main(argc - 1, argv + 1);
+  } else if (strcmp(argv[1], "index-stats") == 0) {
+    return_value = index_stats_main(argc - 1, argv + 1);
   } else if (strcmp(argv[1], "map") == 0) {
     return_value = map_main(argc - 1, argv + 1);
   } else {
@@ -1,27 +1,345 @@
 #include "FEM_index.h"
 
+#include <ctype.h>
+#include <getopt.h>
+
 #include "index.h"
 #include "sequence_batch.h"
 #include "utils.h"
 
 static inline void print_usage() {
-  fprintf(stderr, "Usage: FEM index <window_size> <step_size> <reference> <output>\n");
+  fprintf(stderr, "Usage: FEM index [options] <window_size> <step_size> <reference> <output>\n\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "        -t       INT  number of threads [1]\n");
+  fprintf(stderr, "        --low-memory   count k-mers and scatter locations instead of sorting, so peak memory is the final index\n");
+  fprintf(stderr, "        --compact      store occurrences as 32-bit (40-bit above 4 Gbp) offsets into the concatenated reference\n");
+  fprintf(stderr, "        --compress     store occurrences as delta-coded StreamVByte blocks of offsets into the concatenated reference (up to 4 Gbp)\n");
+  fprintf(stderr, "        --succinct     store the lookup table with Elias-Fano coding, which makes larger window sizes affordable\n");
+  fprintf(stderr, "        --sparse       store only the k-mers that occur, in a two-level table, for window sizes up to %d (required above %d)\n", INDEX_MAX_SPARSE_KMER_SIZE, INDEX_MAX_DENSE_KMER_SIZE);
+  fprintf(stderr, "        --canonical    file each seed under the smaller of its k-mer and its reverse complement, so one lookup serves both strands of a read\n");
+  fprintf(stderr, "        --minimizers   index the (w,k)-minimizers of the reference with w = <step_size> instead of every <step_size>-th seed, so a read has a single seed group\n");
+  fprintf(stderr, "        --skip-ambiguous   do not index seeds that overlap an ambiguous base (N) instead of reading it as A\n");
+  fprintf(stderr, "        --max-bucket-size INT  move the buckets of seeds occurring more than INT times to a separate repeat table [0, no limit]\n");
+  fprintf(stderr, "        --drop-repeats   keep only the frequencies of repeats, not their locations\n");
+  fprintf(stderr, "        --no-reference   do not embed the 2-bit packed reference, so FEM map needs --ref\n");
+  fprintf(stderr, "        --build-memory SIZE  build the index out of core, holding at most SIZE bytes of seeds (K/M/G suffixes) in memory and spilling sorted runs to disk\n");
+  fprintf(stderr, "        --tmp-dir      STR   directory for the spilled runs [directory of <output>]\n");
+  fprintf(stderr, "        --direct-io    write the index file with O_DIRECT, bypassing the page cache\n");
+  fprintf(stderr, "        --append       STR   add the sequences of <reference> to the index STR of the same window and step size, writing the merged index to <output>\n");
+  fprintf(stderr, "        --zlib         save the index as zlib-compressed blocks, which FEM map decompresses in parallel into memory instead of mapping the file\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Step size selection:\n");
+  fprintf(stderr, "        --max-memory   SIZE  choose the smallest legal step size whose index and reference fit in SIZE bytes (K/M/G suffixes); pass \"auto\" as <step_size>\n");
+  fprintf(stderr, "        --dry-run            print the predicted memory and exit without building the index; <output> may be omitted\n");
+  fprintf(stderr, "        --read-length  INT   target read length [100]\n");
+  fprintf(stderr, "        -e             INT   target error threshold [2]\n");
+  fprintf(stderr, "        -a             INT   target # additional q-grams [1]\n");
+  fprintf(stderr, "\n");
+}
+
+// Parses a size such as "512M" or "16G" into bytes. Returns 0 on error.
+static size_t parse_size_in_bytes(const char *size_string) {
+  char *suffix = NULL;
+  double size = strtod(size_string, &suffix);
+  if (suffix == size_string || size <= 0) {
+    return 0;
+  }
+  switch (toupper(*suffix)) {
+    case 'K':
+      size *= 1024.0;
+      break;
+    case 'M':
+      size *= 1024.0 * 1024.0;
+      break;
+    case 'G':
+      size *= 1024.0 * 1024.0 * 1024.0;
+      break;
+    case 'T':
+      size *= 1024.0 * 1024.0 * 1024.0 * 1024.0;
+      break;
+    case '\0':
+      break;
+    default:
+      return 0;
+  }
+  return (size_t)size;
+}
+
+// The mapper needs error_threshold + 1 + num_additional_qgrams seeds in every
+// seed group of a read, which bounds the step size from above. Minimizer seeds
+// come from as many disjoint windows of w + k - 1 bases, which must start
+// before the last window of the read.
+static inline int get_max_step_size(int kmer_size, int read_length, int error_threshold, int num_additional_qgrams, int minimizer_seeds) {
+  if (minimizer_seeds) {
+    return (read_length + 1) / (error_threshold + 2 + num_additional_qgrams) - kmer_size + 1;
+  }
+  return (read_length - kmer_size + 1) / (error_threshold + 1 + num_additional_qgrams);
+}
+
+// Returns the smallest legal step size whose predicted memory is within the
+// budget, or 0 if even the largest legal step size does not fit.
+static int choose_step_size_by_memory(const SequenceBatch *reference_sequence_batch, Index *index, int max_step_size, size_t max_memory, IndexMemoryEstimate *estimate) {
+  for (int step_size = 1; step_size <= max_step_size; ++step_size) {
+    index->step_size = step_size;
+    estimate_index_memory(reference_sequence_batch, index, estimate);
+    if (estimate->total_size <= max_memory) {
+      return step_size;
+    }
+  }
+  return 0;
 }
 
 int index_main(int argc, char* argv[]) {
-  if (argc < 5) {
+  int num_threads = 1;
+  int construction_method = INDEX_CONSTRUCTION_BY_SORTING;
+  int occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_LOCATION;
+  int lookup_table_encoding = INDEX_LOOKUP_TABLE_DENSE;
+  size_t max_memory = 0;
+  int dry_run = 0;
+  int read_length = 100;
+  int error_threshold = 2;
+  int num_additional_qgrams = 1;
+  int skip_ambiguous_seeds = 0;
+  int embed_reference = 1;
+  int canonical_seeds = 0;
+  int minimizer_seeds = 0;
+  int direct_io = 0;
+  int compress_index_file = 0;
+  const char *append_index_file_path = NULL;
+  uint32_t max_bucket_size = 0;
+  int keep_repeat_occurrences = 1;
+  size_t build_memory = 0;
+  const char *temporary_directory = NULL;
+  const char *short_opt = "ht:LCZSXM:DR:e:a:B:T:U:ONEIzA:KW";
+  struct option long_opt[] =
+  {
+    {"help", no_argument, NULL, 'h'},
+    {"low-memory", no_argument, NULL, 'L'},
+    {"compact", no_argument, NULL, 'C'},
+    {"compress", no_argument, NULL, 'Z'},
+    {"succinct", no_argument, NULL, 'S'},
+    {"sparse", no_argument, NULL, 'X'},
+    {"max-memory", required_argument, NULL, 'M'},
+    {"dry-run", no_argument, NULL, 'D'},
+    {"read-length", required_argument, NULL, 'R'},
+    {"skip-ambiguous", no_argument, NULL, 'N'},
+    {"no-reference", no_argument, NULL, 'E'},
+    {"max-bucket-size", required_argument, NULL, 'U'},
+    {"drop-repeats", no_argument, NULL, 'O'},
+    {"build-memory", required_argument, NULL, 'B'},
+    {"tmp-dir", required_argument, NULL, 'T'},
+    {"direct-io", no_argument, NULL, 'I'},
+    {"zlib", no_argument, NULL, 'z'},
+    {"append", required_argument, NULL, 'A'},
+    {"canonical", no_argument, NULL, 'K'},
+    {"minimizers", no_argument, NULL, 'W'},
+    {NULL, 0, NULL, 0}
+  };
+  int c, option_index;
+  while ((c = getopt_long(argc, argv, short_opt, long_opt, &option_index)) >= 0) {
+    switch (c) {
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+      case 'L':
+        construction_method = INDEX_CONSTRUCTION_BY_COUNTING;
+        break;
+      case 'C':
+        if (occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+          fprintf(stderr, "%s\n", "--compact and --compress cannot be used together.");
+          exit(EXIT_FAILURE);
+        }
+        occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32;
+        break;
+      case 'Z':
+        if (occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32) {
+          fprintf(stderr, "%s\n", "--compact and --compress cannot be used together.");
+          exit(EXIT_FAILURE);
+        }
+        occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS;
+        break;
+      case 'S':
+        if (lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+          fprintf(stderr, "%s\n", "--succinct and --sparse cannot be used together.");
+          exit(EXIT_FAILURE);
+        }
+        lookup_table_encoding = INDEX_LOOKUP_TABLE_ELIAS_FANO;
+        break;
+      case 'X':
+        if (lookup_table_encoding == INDEX_LOOKUP_TABLE_ELIAS_FANO) {
+          fprintf(stderr, "%s\n", "--succinct and --sparse cannot be used together.");
+          exit(EXIT_FAILURE);
+        }
+        lookup_table_encoding = INDEX_LOOKUP_TABLE_SPARSE;
+        break;
+      case 'M':
+        max_memory = parse_size_in_bytes(optarg);
+        if (max_memory == 0) {
+          fprintf(stderr, "%s\n", "Wrong memory size.");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'D':
+        dry_run = 1;
+        break;
+      case 'R':
+        read_length = atoi(optarg);
+        break;
+      case 'e':
+        error_threshold = atoi(optarg);
+        break;
+      case 'a':
+        num_additional_qgrams = atoi(optarg);
+        break;
+      case 'B':
+        build_memory = parse_size_in_bytes(optarg);
+        if (build_memory == 0) {
+          fprintf(stderr, "%s\n", "Wrong memory size.");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'T':
+        temporary_directory = optarg;
+        break;
+      case 'U':
+        max_bucket_size = atoi(optarg);
+        break;
+      case 'O':
+        keep_repeat_occurrences = 0;
+        break;
+      case 'N':
+        skip_ambiguous_seeds = 1;
+        break;
+      case 'E':
+        embed_reference = 0;
+        break;
+      case 'I':
+        direct_io = 1;
+        break;
+      case 'z':
+        compress_index_file = 1;
+        break;
+      case 'A':
+        append_index_file_path = optarg;
+        break;
+      case 'K':
+        canonical_seeds = 1;
+        break;
+      case 'W':
+        minimizer_seeds = 1;
+        break;
+      default:
+        print_usage();
+        exit(EXIT_SUCCESS);
+    }
+  }
+  if (argc - optind < 4 && !(dry_run && argc - optind == 3)) {
     fprintf(stderr, "%s\n", "Too few args!");
     print_usage();
     exit(EXIT_FAILURE);
   }
+  if (num_threads <= 0) {
+    fprintf(stderr, "%s\n", "Wrong number of threads.");
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
 
-  int kmer_size = atoi(argv[1]);
-  int step_size = atoi(argv[2]);
-  const char *reference_file_path = argv[3];
-  const char *index_file_path = argv[4];
-  fprintf(stderr, "k: %d, step size: %d, reference: %s, output: %s\n", kmer_size, step_size, reference_file_path, index_file_path);
+  int kmer_size = atoi(argv[optind]);
+  if (kmer_size < 1 || kmer_size > INDEX_MAX_SPARSE_KMER_SIZE) {
+    fprintf(stderr, "Window size must be between 1 and %d.\n", INDEX_MAX_SPARSE_KMER_SIZE);
+    exit(EXIT_FAILURE);
+  }
+  if (kmer_size > INDEX_MAX_DENSE_KMER_SIZE && lookup_table_encoding != INDEX_LOOKUP_TABLE_SPARSE) {
+    fprintf(stderr, "Window sizes above %d require --sparse.\n", INDEX_MAX_DENSE_KMER_SIZE);
+    exit(EXIT_FAILURE);
+  }
+  int choose_step_size = strcmp(argv[optind + 1], "auto") == 0;
+  int step_size = choose_step_size ? 0 : atoi(argv[optind + 1]);
+  const char *reference_file_path = argv[optind + 2];
+  const char *index_file_path = argc - optind > 3 ? argv[optind + 3] : NULL;
+  if (choose_step_size && max_memory == 0) {
+    fprintf(stderr, "%s\n", "Step size \"auto\" requires --max-memory.");
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
+  if (!choose_step_size && step_size < 1) {
+    fprintf(stderr, "%s\n", "Step size must be at least 1.");
+    exit(EXIT_FAILURE);
+  }
+  int max_step_size = get_max_step_size(kmer_size, read_length, error_threshold, num_additional_qgrams, minimizer_seeds);
+  if (max_step_size < 1) {
+    fprintf(stderr, "%s\n", "Reads of the target length are too short for this window size and error threshold.");
+    exit(EXIT_FAILURE);
+  }
+  if (!choose_step_size && step_size > max_step_size) {
+    fprintf(stderr, "Warning: step size %d is larger than %d, the largest one for reads of length %d with %d errors.\n", step_size, max_step_size, read_length, error_threshold);
+  }
+  fprintf(stderr, "k: %d, %s: %s, reference: %s, output: %s, threads: %d\n", kmer_size, minimizer_seeds ? "minimizer window" : "step size", argv[optind + 1], reference_file_path, index_file_path != NULL ? index_file_path : "none", num_threads);
   // TODO: check arguments
 
+  if (!keep_repeat_occurrences && max_bucket_size == 0) {
+    fprintf(stderr, "%s\n", "--drop-repeats requires --max-bucket-size.");
+    exit(EXIT_FAILURE);
+  }
+
+  // The sparse table is built from the sorted seeds in one pass and keeps
+  // plain locations.
+  if (lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE && (construction_method != INDEX_CONSTRUCTION_BY_SORTING || occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION || max_bucket_size > 0 || build_memory > 0)) {
+    fprintf(stderr, "%s\n", "--sparse cannot be used with --low-memory, --compact, --compress, --max-bucket-size or --build-memory.");
+    exit(EXIT_FAILURE);
+  }
+
+  // The strand bit is kept in the high bit of a plain location.
+  if (canonical_seeds && occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION) {
+    fprintf(stderr, "%s\n", "--canonical cannot be used with --compact or --compress.");
+    exit(EXIT_FAILURE);
+  }
+
+  // The new sequences are indexed on their own and merged into the old index,
+  // which only works for plain tables.
+  if (append_index_file_path != NULL && (dry_run || choose_step_size || !embed_reference || build_memory > 0 || occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION || lookup_table_encoding != INDEX_LOOKUP_TABLE_DENSE || max_bucket_size > 0)) {
+    fprintf(stderr, "%s\n", "--append cannot be used with --dry-run, --max-memory, --no-reference, --build-memory, --compact, --compress, --succinct, --sparse or --max-bucket-size.");
+    exit(EXIT_FAILURE);
+  }
+
+  if (build_memory > 0) {
+    // The reference is never loaded as a whole, so nothing can be estimated
+    // or encoded after construction.
+    if (dry_run || choose_step_size || index_file_path == NULL || construction_method != INDEX_CONSTRUCTION_BY_SORTING || occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION || lookup_table_encoding != INDEX_LOOKUP_TABLE_DENSE || max_bucket_size > 0 || compress_index_file) {
+      fprintf(stderr, "%s\n", "--build-memory cannot be used with --dry-run, --max-memory, --low-memory, --compact, --compress, --succinct, --max-bucket-size or --zlib.");
+      exit(EXIT_FAILURE);
+    }
+    char *output_directory = NULL;
+    if (temporary_directory == NULL) {
+      output_directory = strdup(index_file_path);
+      char *last_slash = strrchr(output_directory, '/');
+      if (last_slash == NULL) {
+        strcpy(output_directory, ".");
+      } else {
+        last_slash[last_slash == output_directory ? 1 : 0] = '\0';
+      }
+      temporary_directory = output_directory;
+    }
+    Index index;
+    initialize_index(&index);
+    index.kmer_size = kmer_size;
+    index.step_size = step_size;
+    index.skip_ambiguous_seeds = skip_ambiguous_seeds;
+    index.embed_reference = embed_reference;
+    index.canonical_seeds = canonical_seeds;
+    index.minimizer_seeds = minimizer_seeds;
+    index.num_threads = num_threads;
+    index.direct_io = direct_io;
+    construct_index_out_of_core(reference_file_path, index_file_path, build_memory, temporary_directory, &index);
+    destroy_index(&index);
+    if (output_directory != NULL) {
+      free(output_directory);
+    }
+    return 0;
+  }
+
   SequenceBatch reference_sequence_batch;
   initialize_sequence_batch(&reference_sequence_batch);
   initialize_sequence_batch_loading(reference_file_path, &reference_sequence_batch);
@@ -30,10 +348,200 @@ int index_main(int argc, char* argv[]) {
   initialize_index(&index);
   index.kmer_size = kmer_size;
   index.step_size = step_size;
-  construct_index(&reference_sequence_batch, &index);
-  save_index(index_file_path, &index);
+  index.num_threads = num_threads;
+  index.direct_io = direct_io;
+  index.compress_index_file = compress_index_file;
+  index.construction_method = construction_method;
+  index.occurrence_table_encoding = occurrence_table_encoding;
+  index.lookup_table_encoding = lookup_table_encoding;
+  index.max_bucket_size = max_bucket_size;
+  index.skip_ambiguous_seeds = skip_ambiguous_seeds;
+  index.embed_reference = embed_reference;
+  index.canonical_seeds = canonical_seeds;
+  index.minimizer_seeds = minimizer_seeds;
+  index.keep_repeat_occurrences = keep_repeat_occurrences;
+  IndexMemoryEstimate memory_estimate;
+  if (choose_step_size) {
+    index.step_size = choose_step_size_by_memory(&reference_sequence_batch, &index, max_step_size, max_memory, &memory_estimate);
+    if (index.step_size == 0) {
+      fprintf(stderr, "No legal step size fits in %.2f MB. Predicted memory with the largest legal step size %d:\n", max_memory / 1048576.0, max_step_size);
+      print_index_memory_estimate(&memory_estimate);
+      exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Chose step size %d (largest legal step size for reads of length %d with %d errors: %d).\n", index.step_size, read_length, error_threshold, max_step_size);
+  } else {
+    estimate_index_memory(&reference_sequence_batch, &index, &memory_estimate);
+  }
+  fprintf(stderr, "Predicted memory with k %d and step size %d:\n", index.kmer_size, index.step_size);
+  print_index_memory_estimate(&memory_estimate);
+  if (max_memory > 0 && memory_estimate.total_size > max_memory) {
+    fprintf(stderr, "Warning: the predicted memory exceeds --max-memory.\n");
+  }
+  if (!dry_run) {
+    if (index_file_path == NULL) {
+      fprintf(stderr, "%s\n", "Output file path is required.");
+      exit(EXIT_FAILURE);
+    }
+    construct_index(&reference_sequence_batch, &index);
+    if (append_index_file_path != NULL) {
+      Index appended_index;
+      initialize_index(&appended_index);
+      appended_index.num_threads = num_threads;
+      appended_index.direct_io = direct_io;
+      load_index(append_index_file_path, &appended_index);
+      Index merged_index;
+      initialize_index(&merged_index);
+      merged_index.num_threads = num_threads;
+      merged_index.direct_io = direct_io;
+      merged_index.compress_index_file = compress_index_file;
+      merge_indexes(&appended_index, &index, &merged_index);
+      save_index(index_file_path, &merged_index);
+      destroy_index(&merged_index);
+      destroy_index(&appended_index);
+    } else {
+      save_index(index_file_path, &index);
+    }
+  }
   destroy_index(&index);
   finalize_sequence_batch_loading(&reference_sequence_batch);
   destory_sequence_batch(&reference_sequence_batch);
   return 0;
 }
+
+static inline void print_index_merge_usage() {
+  fprintf(stderr, "Usage: FEM index-merge [options] <first_index> <second_index> <output>\n\n");
+  fprintf(stderr, "Merges two indexes with the same window and step size into one over the sequences of <first_index> followed by those of <second_index>.\n");
+  fprintf(stderr, "Both must embed their reference and use the default tables.\n\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "        -t       INT  number of threads [1]\n");
+  fprintf(stderr, "        --direct-io    read and write the index files with O_DIRECT, bypassing the page cache\n");
+  fprintf(stderr, "        --zlib         save the merged index as zlib-compressed blocks\n");
+  fprintf(stderr, "\n");
+}
+
+int index_merge_main(int argc, char* argv[]) {
+  int num_threads = 1;
+  int direct_io = 0;
+  int compress_index_file = 0;
+  const char *short_opt = "ht:Iz";
+  struct option long_opt[] =
+  {
+    {"help", no_argument, NULL, 'h'},
+    {"direct-io", no_argument, NULL, 'I'},
+    {"zlib", no_argument, NULL, 'z'},
+    {NULL, 0, NULL, 0}
+  };
+  int c, option_index;
+  while ((c = getopt_long(argc, argv, short_opt, long_opt, &option_index)) >= 0) {
+    switch (c) {
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+      case 'I':
+        direct_io = 1;
+        break;
+      case 'z':
+        compress_index_file = 1;
+        break;
+      default:
+        print_index_merge_usage();
+        exit(EXIT_SUCCESS);
+    }
+  }
+  if (argc - optind < 3) {
+    fprintf(stderr, "%s\n", "Too few args!");
+    print_index_merge_usage();
+    exit(EXIT_FAILURE);
+  }
+  if (num_threads <= 0) {
+    fprintf(stderr, "%s\n", "Wrong number of threads.");
+    print_index_merge_usage();
+    exit(EXIT_FAILURE);
+  }
+  Index indexes[2];
+  for (int i = 0; i < 2; ++i) {
+    initialize_index(indexes + i);
+    indexes[i].num_threads = num_threads;
+    indexes[i].direct_io = direct_io;
+    load_index(argv[optind + i], indexes + i);
+  }
+  Index merged_index;
+  initialize_index(&merged_index);
+  merged_index.num_threads = num_threads;
+  merged_index.direct_io = direct_io;
+  merged_index.compress_index_file = compress_index_file;
+  merge_indexes(indexes, indexes + 1, &merged_index);
+  save_index(argv[optind + 2], &merged_index);
+  destroy_index(&merged_index);
+  destroy_index(indexes);
+  destroy_index(indexes + 1);
+  return 0;
+}
+
+static inline void print_index_stats_usage() {
+  fprintf(stderr, "Usage: FEM index-stats [options] <index>\n\n");
+  fprintf(stderr, "Prints the bucket size histogram, the largest buckets, the memory of each table and the expected number of locations per seed.\n\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "        -t       INT  number of threads that read the index [1]\n");
+  fprintf(stderr, "        --top          INT   number of largest buckets to list [20]\n");
+  fprintf(stderr, "        --read-length  INT   read length [100]\n");
+  fprintf(stderr, "        -e             INT   error threshold [2]\n");
+  fprintf(stderr, "        -a             INT   # additional q-grams [1]\n");
+  fprintf(stderr, "\n");
+}
+
+int index_stats_main(int argc, char* argv[]) {
+  int num_threads = 1;
+  int num_largest_buckets = 20;
+  int read_length = 100;
+  int error_threshold = 2;
+  int num_additional_qgrams = 1;
+  const char *short_opt = "ht:P:R:e:a:";
+  struct option long_opt[] =
+  {
+    {"help", no_argument, NULL, 'h'},
+    {"top", required_argument, NULL, 'P'},
+    {"read-length", required_argument, NULL, 'R'},
+    {NULL, 0, NULL, 0}
+  };
+  int c, option_index;
+  while ((c = getopt_long(argc, argv, short_opt, long_opt, &option_index)) >= 0) {
+    switch (c) {
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+      case 'P':
+        num_largest_buckets = atoi(optarg);
+        break;
+      case 'R':
+        read_length = atoi(optarg);
+        break;
+      case 'e':
+        error_threshold = atoi(optarg);
+        break;
+      case 'a':
+        num_additional_qgrams = atoi(optarg);
+        break;
+      default:
+        print_index_stats_usage();
+        exit(EXIT_SUCCESS);
+    }
+  }
+  if (argc - optind < 1) {
+    fprintf(stderr, "%s\n", "Too few args!");
+    print_index_stats_usage();
+    exit(EXIT_FAILURE);
+  }
+  if (num_threads <= 0 || num_largest_buckets < 0 || error_threshold < 0 || num_additional_qgrams < 0) {
+    fprintf(stderr, "%s\n", "Wrong number of threads, buckets, errors or additional q-grams.");
+    print_index_stats_usage();
+    exit(EXIT_FAILURE);
+  }
+  Index index;
+  initialize_index(&index);
+  index.num_threads = num_threads;
+  load_index(argv[optind], &index);
+  print_index_statistics(&index, num_largest_buckets, read_length, error_threshold, num_additional_qgrams);
+  destroy_index(&index);
+  return 0;
+}
@@ -2,5 +2,7 @@
 #define FEMINDEX_H
 
 int index_main(int argc, char* argv[]);
+int index_merge_main(int argc, char* argv[]);
+int index_stats_main(int argc, char* argv[]);
 
 #endif
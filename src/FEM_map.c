@@ -16,10 +16,17 @@ static inline void print_usage() {
   fprintf(stderr, "        -t       INT  number of threads \n");
   fprintf(stderr, "        -f       STR  seeding algorithm: \"g\" for group seeding and \"v\" for variable-length seeding \n");
   fprintf(stderr, "        -a       INT  # additional q-grams (only for test)\n");
+  fprintf(stderr, "        --prefault STR  prefault the mapped index: \"none\", \"populate\" (MAP_POPULATE), \"parallel\" (with -t threads) or \"read\" (read into private memory with -t threads) [none]\n");
+  fprintf(stderr, "        --direct-io  read the index into private memory with O_DIRECT, bypassing the page cache\n");
+  fprintf(stderr, "        --huge-pages STR  back the index and reference with \"none\", \"transparent\" or \"explicit\" (preallocated hugetlb) huge pages [none]\n");
+  fprintf(stderr, "        --numa STR  place the index and reference: \"none\" (first touch), \"interleave\" across the NUMA nodes or \"replicate\" on every node, with each thread bound to one copy [none]\n");
+  fprintf(stderr, "        --repeat-policy STR  seed groups that need a seed from the repeat table: \"full\" to use its locations or \"skip\" to generate no candidates from them [full]\n");
+  fprintf(stderr, "        --max-occ INT  leave a read unmapped when the optimal seeds of its two strands have more than INT occurrences in total, 0 for no limit [0]\n");
+  fprintf(stderr, "        --filter STR  gather the candidates of a seed group: \"merge\" to merge the locations of all its seeds, \"vote\" to count them per diagonal bin and sort only the ones in bins with enough votes, or \"gallop\" to search the -a most frequent seeds only near the locations of the others [merge]\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Input/output: ");
   fprintf(stderr, "\n");
-  fprintf(stderr, "        --ref    STR  Input reference file\n");
+  fprintf(stderr, "        --ref    STR  Input reference file, optional if the index embeds the reference\n");
   fprintf(stderr, "        --index  STR  Input index file\n");
   fprintf(stderr, "        --read1  STR  Input read1 file\n");
   fprintf(stderr, "        -o       STR  Output SAM file \n");
@@ -39,10 +46,6 @@ static inline int check_args(const FEMArgs *fem_args, const char *reference_file
     fprintf(stderr, "%s\n", "Wrong number of additional q-grams.");
     return 0;
   }
-  if (reference_file_path == NULL) {
-    fprintf(stderr, "%s\n", "Reference file path is required.");
-    return 0;
-  } 
   if (read1_file_path == NULL) {
     fprintf(stderr, "%s\n", "Read file path is required.");
     return 0;
@@ -54,6 +57,23 @@ static inline int check_args(const FEMArgs *fem_args, const char *reference_file
   return 1;
 }
 
+// The locations in the index are only meaningful for the reference it was
+// built from, which an embedded reference allows to check.
+static void check_embedded_reference(const PackedReference *embedded_reference, const SequenceBatch *reference_sequence_batch) {
+  if (embedded_reference->num_sequences == 0) {
+    return;
+  }
+  int is_same_reference = embedded_reference->num_sequences == reference_sequence_batch->num_loaded_sequences;
+  for (uint32_t sequence_index = 0; is_same_reference && sequence_index < embedded_reference->num_sequences; ++sequence_index) {
+    uint64_t sequence_length = kv_A(embedded_reference->sequence_offsets.v, sequence_index + 1) - kv_A(embedded_reference->sequence_offsets.v, sequence_index);
+    is_same_reference = sequence_length == get_sequence_length_from_sequence_batch_at(reference_sequence_batch, sequence_index);
+  }
+  if (!is_same_reference) {
+    fprintf(stderr, "%s\n", "The reference does not match the one the index was built from.");
+    exit(EXIT_FAILURE);
+  }
+}
+
 int map_main(int argc, char *argv[]) {
   {
   int a = 2, b = 3, c = 5, d = 9, e = 17, f = 33, g = 139;
@@ -70,16 +90,31 @@ int map_main(int argc, char *argv[]) {
   fem_args.num_additional_qgrams = 1;
   fem_args.num_threads = 1;
   fem_args.seeding_method = 'g'; // "v" for variable length seeding, "g" for group seeding.
+  fem_args.repeat_policy = REPEAT_POLICY_FULL;
+  fem_args.filter_engine = FILTER_ENGINE_MERGE;
+  fem_args.max_num_occurrences = 0;
+  int index_prefault_mode = INDEX_PREFAULT_NONE;
+  int index_direct_io = 0;
+  MemoryPlacement memory_placement;
+  initialize_memory_placement(&memory_placement);
 
   //initialize_fem_args(&fem_args);
   // Parse args
-  const char *short_opt = "ha:f:e:t:o:r:i:b:";
+  const char *short_opt = "ha:f:e:t:o:r:i:b:P:y:H:N:IF:M:";
   struct option long_opt[] = 
   {
     {"help", no_argument, NULL, 'h'},
     {"ref", required_argument, NULL, 'r'},
     {"index", required_argument, NULL, 'i'},
-    {"read1", required_argument, NULL,'b'}
+    {"read1", required_argument, NULL,'b'},
+    {"prefault", required_argument, NULL, 'P'},
+    {"repeat-policy", required_argument, NULL, 'y'},
+    {"huge-pages", required_argument, NULL, 'H'},
+    {"numa", required_argument, NULL, 'N'},
+    {"direct-io", no_argument, NULL, 'I'},
+    {"filter", required_argument, NULL, 'F'},
+    {"max-occ", required_argument, NULL, 'M'},
+    {NULL, 0, NULL, 0}
   };
   int c, option_index;
   while((c = getopt_long(argc, argv, short_opt, long_opt, &option_index)) >= 0) {
@@ -116,6 +151,82 @@ int map_main(int argc, char *argv[]) {
           exit(EXIT_FAILURE);
         }
         break;
+      case 'P':
+        if (strcmp(optarg, "none") == 0) {
+          index_prefault_mode = INDEX_PREFAULT_NONE;
+        } else if (strcmp(optarg, "populate") == 0) {
+          index_prefault_mode = INDEX_PREFAULT_POPULATE;
+        } else if (strcmp(optarg, "parallel") == 0) {
+          index_prefault_mode = INDEX_PREFAULT_PARALLEL;
+        } else if (strcmp(optarg, "read") == 0) {
+          index_prefault_mode = INDEX_PREFAULT_READ;
+        } else {
+          fprintf(stderr, "%s\n", "Wrong prefault mode!");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'y':
+        if (strcmp(optarg, "full") == 0) {
+          fem_args.repeat_policy = REPEAT_POLICY_FULL;
+        } else if (strcmp(optarg, "skip") == 0) {
+          fem_args.repeat_policy = REPEAT_POLICY_SKIP;
+        } else {
+          fprintf(stderr, "%s\n", "Wrong repeat policy!");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'M':
+        if (atoll(optarg) < 0 || atoll(optarg) > UINT32_MAX - 1) {
+          fprintf(stderr, "%s\n", "Wrong occurrence budget!");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        fem_args.max_num_occurrences = atoll(optarg);
+        break;
+      case 'F':
+        if (strcmp(optarg, "merge") == 0) {
+          fem_args.filter_engine = FILTER_ENGINE_MERGE;
+        } else if (strcmp(optarg, "vote") == 0) {
+          fem_args.filter_engine = FILTER_ENGINE_VOTE;
+        } else if (strcmp(optarg, "gallop") == 0) {
+          fem_args.filter_engine = FILTER_ENGINE_GALLOP;
+        } else {
+          fprintf(stderr, "%s\n", "Wrong filter engine!");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'H':
+        if (strcmp(optarg, "none") == 0) {
+          memory_placement.huge_pages = MEMORY_HUGE_PAGES_NONE;
+        } else if (strcmp(optarg, "transparent") == 0) {
+          memory_placement.huge_pages = MEMORY_HUGE_PAGES_TRANSPARENT;
+        } else if (strcmp(optarg, "explicit") == 0) {
+          memory_placement.huge_pages = MEMORY_HUGE_PAGES_EXPLICIT;
+        } else {
+          fprintf(stderr, "%s\n", "Wrong huge page mode!");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'N':
+        if (strcmp(optarg, "none") == 0) {
+          memory_placement.numa_policy = MEMORY_NUMA_NONE;
+        } else if (strcmp(optarg, "interleave") == 0) {
+          memory_placement.numa_policy = MEMORY_NUMA_INTERLEAVE;
+        } else if (strcmp(optarg, "replicate") == 0) {
+          memory_placement.numa_policy = MEMORY_NUMA_REPLICATE;
+        } else {
+          fprintf(stderr, "%s\n", "Wrong NUMA policy!");
+          print_usage();
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'I':
+        index_direct_io = 1;
+        break;
       case 'o':
         output_file_path = optarg;
         fprintf(stderr, "output: %s\n", output_file_path);
@@ -132,15 +243,66 @@ int map_main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  // Load reference
-  SequenceBatch reference_sequence_batch;
-  initialize_sequence_batch(&reference_sequence_batch);
-  initialize_sequence_batch_loading(reference_file_path, &reference_sequence_batch);
-  load_all_sequences_into_sequence_batch(&reference_sequence_batch);
-
-  // Load index
-  Index index;
-  load_index(index_file_path, &index);
+  // With replication, the reference and the index are loaded once per NUMA
+  // node, and mapping thread i uses copy i % num_replicas.
+  int numa_nodes[MEMORY_MAX_NUMA_NODES];
+  int num_replicas = 1;
+  if (memory_placement.numa_policy == MEMORY_NUMA_REPLICATE) {
+    num_replicas = get_online_numa_nodes(numa_nodes);
+    fprintf(stderr, "Replicating the reference and the index on %d NUMA nodes.\n", num_replicas);
+  }
+  // Only the names and lengths of the reference are kept as a sequence batch,
+  // and the candidates are verified against the packed reference, which is
+  // the one embedded in the index when there is one.
+  SequenceBatch reference_sequence_batches[num_replicas];
+  PackedReference loaded_packed_references[num_replicas];
+  const PackedReference *packed_references[num_replicas];
+  Index indexes[num_replicas];
+  for (int replica_index = 0; replica_index < num_replicas; ++replica_index) {
+    MemoryPlacement replica_placement = memory_placement;
+    if (memory_placement.numa_policy == MEMORY_NUMA_REPLICATE) {
+      replica_placement.numa_node = numa_nodes[replica_index];
+    }
+    // Load index
+    Index *index = indexes + replica_index;
+    initialize_index(index);
+    index->prefault_mode = index_prefault_mode;
+    index->direct_io = index_direct_io;
+    index->memory_placement = replica_placement;
+    index->num_threads = fem_args.num_threads;
+    load_index(index_file_path, index);
+    // Load reference
+    SequenceBatch *reference_sequence_batch = reference_sequence_batches + replica_index;
+    initialize_sequence_batch(reference_sequence_batch);
+    initialize_packed_reference(loaded_packed_references + replica_index);
+    packed_references[replica_index] = &(index->reference);
+    if (reference_file_path != NULL) {
+      initialize_sequence_batch_loading(reference_file_path, reference_sequence_batch);
+      load_all_sequences_into_sequence_batch(reference_sequence_batch);
+      finalize_sequence_batch_loading(reference_sequence_batch);
+      check_embedded_reference(&(index->reference), reference_sequence_batch);
+      if (index->reference.num_sequences == 0) {
+        pack_sequence_batch(reference_sequence_batch, loaded_packed_references + replica_index);
+        if (!is_default_memory_placement(&replica_placement)) {
+          place_packed_reference(&replica_placement, loaded_packed_references + replica_index);
+        }
+        packed_references[replica_index] = loaded_packed_references + replica_index;
+      }
+      release_sequence_bases_in_sequence_batch(reference_sequence_batch);
+    } else if (index->reference.num_sequences > 0) {
+      load_sequence_names_from_packed_reference(&(index->reference), reference_sequence_batch);
+    } else {
+      fprintf(stderr, "%s\n", "The index has no embedded reference, so --ref is required.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // Seeds must be sampled the same way as the index was built
+  fem_args.kmer_size = indexes[0].kmer_size;
+  fem_args.step_size = indexes[0].step_size;
+  if (indexes[0].max_bucket_size > 0 && !indexes[0].keep_repeat_occurrences && fem_args.repeat_policy == REPEAT_POLICY_FULL) {
+    fprintf(stderr, "The index has no locations for repeats, so seed groups that need them are skipped.\n");
+    fem_args.repeat_policy = REPEAT_POLICY_SKIP;
+  }
 
   pthread_t mapping_thread_handles[fem_args.num_threads];
   pthread_t input_queue_thread_handle;
@@ -152,14 +314,16 @@ int map_main(int argc, char *argv[]) {
   initialize_input_queue(read1_file_path, read_batch_max_size, input_queue_max_size, &input_queue);
   OutputQueue output_queue;
   uint32_t output_queue_max_size = 100000;
-  initialize_output_queue(output_file_path, &reference_sequence_batch, fem_args.num_threads, output_queue_max_size, &output_queue);
+  initialize_output_queue(output_file_path, reference_sequence_batches, fem_args.num_threads, output_queue_max_size, &output_queue);
   MappingArgs mapping_args[fem_args.num_threads];
   for (int i = 0; i < fem_args.num_threads; ++i) {
     mapping_args[i].thread_id = i;
     mapping_args[i].max_read_batch_size = read_batch_max_size;
     mapping_args[i].fem_args = &fem_args;
-    mapping_args[i].reference_sequence_batch = &reference_sequence_batch;
-    mapping_args[i].index = &index;
+    mapping_args[i].reference_sequence_batch = reference_sequence_batches + i % num_replicas;
+    mapping_args[i].packed_reference = packed_references[i % num_replicas];
+    mapping_args[i].index = indexes + i % num_replicas;
+    mapping_args[i].numa_node = memory_placement.numa_policy == MEMORY_NUMA_REPLICATE ? numa_nodes[i % num_replicas] : -1;
     mapping_args[i].input_queue = &input_queue;
     mapping_args[i].output_queue = &output_queue;
     mapping_args[i].mapping_stats.num_reads = 0;
@@ -167,6 +331,7 @@ int map_main(int argc, char *argv[]) {
     mapping_args[i].mapping_stats.num_candidates_without_additonal_qgram_filter = 0;
     mapping_args[i].mapping_stats.num_candidates = 0;
     mapping_args[i].mapping_stats.num_mappings = 0;
+    mapping_args[i].mapping_stats.num_reads_over_occurrence_budget = 0;
   }
 
   double startTime = get_real_time();
@@ -203,12 +368,14 @@ int map_main(int argc, char *argv[]) {
   uint64_t num_candidates_without_additonal_qgram_filter = 0;
   uint64_t num_candidates = 0;
   uint64_t num_mappings = 0;
+  uint64_t num_reads_over_occurrence_budget = 0;
   for (int i = 0; i < fem_args.num_threads; ++i) {
     num_reads += mapping_args[i].mapping_stats.num_reads;
     num_mapped_reads += mapping_args[i].mapping_stats.num_mapped_reads;
     num_candidates_without_additonal_qgram_filter += mapping_args[i].mapping_stats.num_candidates_without_additonal_qgram_filter;
     num_candidates += mapping_args[i].mapping_stats.num_candidates;
     num_mappings += mapping_args[i].mapping_stats.num_mappings;
+    num_reads_over_occurrence_budget += mapping_args[i].mapping_stats.num_reads_over_occurrence_budget;
   }
 
   fprintf(stderr, "The number of read: %"PRIu64"\n", num_reads);
@@ -216,12 +383,17 @@ int map_main(int argc, char *argv[]) {
   fprintf(stderr, "The number of candidate before additional q-gram filter: %"PRIu64"\n", num_candidates_without_additonal_qgram_filter);
   fprintf(stderr, "The number of candidate: %"PRIu64"\n", num_candidates);
   fprintf(stderr, "The number of mapping: %"PRIu64"\n", num_mappings);
+  if (fem_args.max_num_occurrences > 0) {
+    fprintf(stderr, "The number of read over the occurrence budget: %"PRIu64"\n", num_reads_over_occurrence_budget);
+  }
   fprintf(stderr, "Time: %fs\n", get_real_time() - startTime);
 
   destroy_output_queue(&output_queue);
   destroy_input_queue(&input_queue);
-  destroy_index(&index);
-  finalize_sequence_batch_loading(&reference_sequence_batch);
-  destory_sequence_batch(&reference_sequence_batch);
+  for (int replica_index = 0; replica_index < num_replicas; ++replica_index) {
+    destroy_index(indexes + replica_index);
+    destroy_packed_reference(loaded_packed_references + replica_index);
+    destory_sequence_batch(reference_sequence_batches + replica_index);
+  }
   return 0;
 }
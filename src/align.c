@@ -1,12 +1,28 @@
 #include "align.h"
 #include "ksort.h"
 
-uint32_t verify_candidates(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, uint32_t read_sequence_index, uint8_t direction, const SequenceBatch *reference_sequence_batch, const uint64_t *candidates, uint32_t num_candidates, kvec_t_Mapping *mappings) {
+static inline void get_read_bases(const char *read_sequence, int read_length, uint8_t *read_bases) {
+  for (int i = 0; i < read_length; ++i) {
+    read_bases[i] = char_to_uint8(read_sequence[i]);
+  }
+}
+
+// A candidate window covers the read and 2e more bases, from the candidate position.
+static inline void get_reference_bases_at_candidate(const PackedReference *packed_reference, uint64_t candidate, uint32_t num_bases, uint8_t *reference_bases) {
+  decode_packed_reference(packed_reference, kv_A(packed_reference->sequence_offsets.v, candidate >> 32) + (uint32_t)candidate, num_bases, reference_bases);
+}
+
+uint32_t verify_candidates(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, uint32_t read_sequence_index, uint8_t direction, const PackedReference *packed_reference, const uint64_t *candidates, uint32_t num_candidates, MappingWorkspace *workspace, kvec_t_Mapping *mappings) {
   int read_length = get_sequence_length_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
   const char *read_sequence = get_sequence_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
   if (direction == NEGATIVE_DIRECTION) {
     read_sequence = get_negative_sequence_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
   }
+  reserve_mapping_workspace(fem_args, read_length, workspace);
+  uint8_t *read_bases = workspace->read_bases;
+  get_read_bases(read_sequence, read_length, read_bases);
+  int reference_window_length = read_length + 2 * fem_args->error_threshold;
+  uint8_t *reference_bases = workspace->reference_bases;
   // Compute how many runs of vectorized code needed
   int num_mappings = 0;
   uint32_t num_vpus = num_candidates / NUM_VPU_LANES;
@@ -17,7 +33,10 @@ uint32_t verify_candidates(const FEMArgs *fem_args, const SequenceBatch *read_se
     for (int li = 0; li < NUM_VPU_LANES; ++li){
       mapping_end_positions[li] = read_length - 1;
     }
-    vectorized_banded_edit_distance(fem_args, vpu_index, reference_sequence_batch, read_sequence, read_length, candidates, num_candidates, mapping_edit_distances, mapping_end_positions);
+    for (int li = 0; li < NUM_VPU_LANES; ++li) {
+      get_reference_bases_at_candidate(packed_reference, candidates[vpu_index * NUM_VPU_LANES + li], reference_window_length, reference_bases + li * reference_window_length);
+    }
+    vectorized_banded_edit_distance(fem_args, reference_bases, reference_window_length, read_bases, read_length, mapping_edit_distances, mapping_end_positions);
     for (int mi = 0; mi < NUM_VPU_LANES; ++mi) {
       if (mapping_edit_distances[mi] <= fem_args->error_threshold) {
         Mapping mapping;
@@ -32,11 +51,9 @@ uint32_t verify_candidates(const FEMArgs *fem_args, const SequenceBatch *read_se
   }
   for (uint32_t ci = 0; ci < num_remains; ++ci) {
     uint64_t candidate = candidates[num_vpus * NUM_VPU_LANES + ci];
-    uint32_t reference_sequence_index = candidate >> 32;
-    uint32_t reference_candidate_position = (uint32_t)candidate;
-    const char *reference_sequence = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index) + (uint32_t)reference_candidate_position;
+    get_reference_bases_at_candidate(packed_reference, candidate, reference_window_length, reference_bases);
     int current_mapping_end_position = -read_length;
-    int current_mapping_edit_distance = banded_edit_distance(fem_args, reference_sequence, read_sequence, read_length, &current_mapping_end_position);
+    int current_mapping_edit_distance = banded_edit_distance(fem_args, reference_bases, read_bases, read_length, &current_mapping_end_position);
     if (current_mapping_edit_distance <= fem_args->error_threshold) {
       Mapping mapping;
       mapping.direction = direction;
@@ -53,15 +70,17 @@ uint32_t verify_candidates(const FEMArgs *fem_args, const SequenceBatch *read_se
 #define MappingSortKey(m) ((((uint64_t)(m).edit_distance)<<60)|(((uint64_t)(m).direction)<<59)|((m).candidate_position+(m).end_position_offset))
 KRADIX_SORT_INIT(mapping, Mapping, MappingSortKey, 8);
 
-uint32_t process_mappings(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, uint32_t read_sequence_index, const SequenceBatch *reference_sequence_batch, Mapping *mappings, uint32_t num_mappings, kvec_t_bam1_t_ptr *sam_alignment_kvec) {
+uint32_t process_mappings(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, uint32_t read_sequence_index, const PackedReference *packed_reference, Mapping *mappings, uint32_t num_mappings, MappingWorkspace *workspace, kvec_t_bam1_t_ptr *sam_alignment_kvec) {
   radix_sort_mapping(mappings, mappings + num_mappings);
-  kstring_t MD_tag = {0, 0, NULL};
-  kvec_t_uint32_t cigar_uint32_t;
-  kv_init(cigar_uint32_t.v);
+  kstring_t *MD_tag = &(workspace->MD_tag);
+  kvec_t_uint32_t *cigar_uint32_t = &(workspace->cigar);
   const char *read_qual = get_sequence_qual_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
   int read_length = get_sequence_length_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
   const char *read_name = get_sequence_name_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
   int read_name_length = get_sequence_name_length_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
+  reserve_mapping_workspace(fem_args, read_length, workspace);
+  uint8_t *read_bases = workspace->read_bases;
+  uint8_t *reference_bases = workspace->reference_bases;
   size_t pre_sam_alignment_kvec_size = kv_size(sam_alignment_kvec->v);
   for (size_t si = 0; si + pre_sam_alignment_kvec_size < num_mappings; ++si) {
     kv_push(bam1_t*, sam_alignment_kvec->v, bam_init1()); 
@@ -72,37 +91,37 @@ uint32_t process_mappings(const FEMArgs *fem_args, const SequenceBatch *read_seq
     uint8_t edit_distance = mappings[mi].edit_distance;
     uint64_t candidate_position = mappings[mi].candidate_position;
     uint32_t reference_sequence_index = candidate_position >> 32;
-    const char *reference_sequence = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index) + (uint32_t)candidate_position;
-    kv_clear(cigar_uint32_t.v);
-    MD_tag.l = 0;
-    int mapping_start_position = generate_alignment(fem_args, reference_sequence, read_sequence, read_length, mappings[mi].edit_distance, mappings[mi].end_position_offset, &cigar_uint32_t, &MD_tag);
+    get_read_bases(read_sequence, read_length, read_bases);
+    get_reference_bases_at_candidate(packed_reference, candidate_position, read_length + 2 * fem_args->error_threshold, reference_bases);
+    kv_clear(cigar_uint32_t->v);
+    MD_tag->l = 0;
+    int mapping_start_position = generate_alignment(fem_args, reference_bases, read_bases, read_length, mappings[mi].edit_distance, mappings[mi].end_position_offset, workspace, cigar_uint32_t, MD_tag);
     read_sequence = get_sequence_from_sequence_batch_at(read_sequence_batch, read_sequence_index);
     mapping_start_position += (uint32_t)candidate_position;
     uint8_t mapping_quality = 255;
     uint16_t flag = mappings[mi].direction == POSITIVE_DIRECTION ? 0 : BAM_FREVERSE;
     if (mi > 0) {
       flag |= BAM_FSECONDARY;
-      generate_bam1_t(edit_distance, &MD_tag, mapping_start_position, reference_sequence_index, mapping_quality, flag, read_name, read_name_length, cigar_uint32_t.v.a, kv_size(cigar_uint32_t.v), read_sequence, read_qual, 0, kv_A(sam_alignment_kvec->v, mi));
+      generate_bam1_t(edit_distance, MD_tag, mapping_start_position, reference_sequence_index, mapping_quality, flag, read_name, read_name_length, cigar_uint32_t->v.a, kv_size(cigar_uint32_t->v), read_sequence, read_qual, 0, kv_A(sam_alignment_kvec->v, mi));
     } else {
-      generate_bam1_t(edit_distance, &MD_tag, mapping_start_position, reference_sequence_index, mapping_quality, flag, read_name, read_name_length, cigar_uint32_t.v.a, kv_size(cigar_uint32_t.v), read_sequence, read_qual, read_length, kv_A(sam_alignment_kvec->v, mi));
+      generate_bam1_t(edit_distance, MD_tag, mapping_start_position, reference_sequence_index, mapping_quality, flag, read_name, read_name_length, cigar_uint32_t->v.a, kv_size(cigar_uint32_t->v), read_sequence, read_qual, read_length, kv_A(sam_alignment_kvec->v, mi));
     }
   }
-  kv_destroy(cigar_uint32_t.v);
   return num_mappings;
 }
 
 // Banded Myers bit-parallel algorithm
 /* @param fem_args             FEM parameters 
-   @param pattern              Reference sequence starting from (candidate position - error threshold) 
-   @param text                 Read sequence
+   @param pattern              Reference base codes starting from (candidate position - error threshold) 
+   @param text                 Read base codes
    @param text_length          Read length
    @param mapping_end_position 0-based mapping end position (inclusive) 
    @return Edit distance of the mapping.
    */
-int banded_edit_distance(const FEMArgs *fem_args, const char *pattern, const char *text, int text_length, int *mapping_end_position) {
+int banded_edit_distance(const FEMArgs *fem_args, const uint8_t *pattern, const uint8_t *text, int text_length, int *mapping_end_position) {
   uint32_t Peq[5] = {0, 0, 0, 0, 0};
   for (int i = 0; i < 2 * fem_args->error_threshold; i++) {
-    uint8_t base = char_to_uint8(pattern[i]);
+    uint8_t base = pattern[i];
     Peq[base] = Peq[base] | (1 << i);
   }
   uint32_t highest_bit_in_band_mask = 1 << (2 * fem_args->error_threshold);
@@ -115,9 +134,9 @@ int banded_edit_distance(const FEMArgs *fem_args, const char *pattern, const cha
   uint32_t HP = 0;
   int num_errors_at_band_start_position = 0;
   for (int i = 0; i < text_length; i++) {
-    uint8_t pattern_base = char_to_uint8(pattern[i + 2 * fem_args->error_threshold]);
+    uint8_t pattern_base = pattern[i + 2 * fem_args->error_threshold];
     Peq[pattern_base] = Peq[pattern_base] | highest_bit_in_band_mask;
-    X = Peq[char_to_uint8(text[i])] | VN;
+    X = Peq[text[i]] | VN;
     D0 = ((VP + (X & VP)) ^ VP) | X;
     HN = VP & D0;
     HP = VN | ~(VP | D0);
@@ -146,23 +165,16 @@ int banded_edit_distance(const FEMArgs *fem_args, const char *pattern, const cha
   return min_num_errors;
 }
 
-void vectorized_banded_edit_distance(const FEMArgs *fem_args, const uint32_t vpu_index, const SequenceBatch *reference_sequence_batch, const char *text, int read_length, const uint64_t *candidates, uint32_t num_candidates, int16_t *mapping_edit_distances, int16_t *mapping_end_positions) {
-  uint32_t reference_sequence_index0 = candidates[vpu_index * NUM_VPU_LANES + 0] >> 32;
-  uint32_t reference_sequence_index1 = candidates[vpu_index * NUM_VPU_LANES + 1] >> 32;
-  uint32_t reference_sequence_index2 = candidates[vpu_index * NUM_VPU_LANES + 2] >> 32;
-  uint32_t reference_sequence_index3 = candidates[vpu_index * NUM_VPU_LANES + 3] >> 32;
-  uint32_t reference_sequence_index4 = candidates[vpu_index * NUM_VPU_LANES + 4] >> 32;
-  uint32_t reference_sequence_index5 = candidates[vpu_index * NUM_VPU_LANES + 5] >> 32;
-  uint32_t reference_sequence_index6 = candidates[vpu_index * NUM_VPU_LANES + 6] >> 32;
-  uint32_t reference_sequence_index7 = candidates[vpu_index * NUM_VPU_LANES + 7] >> 32;
-  const char *reference_sequence0 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index0) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 0];
-  const char *reference_sequence1 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index1) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 1];
-  const char *reference_sequence2 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index2) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 2];
-  const char *reference_sequence3 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index3) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 3];
-  const char *reference_sequence4 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index4) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 4];
-  const char *reference_sequence5 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index5) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 5];
-  const char *reference_sequence6 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index6) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 6];
-  const char *reference_sequence7 = get_sequence_from_sequence_batch_at(reference_sequence_batch, reference_sequence_index7) + (uint32_t)candidates[vpu_index * NUM_VPU_LANES + 7];
+// Lane li aligns the read against patterns + li * pattern_length.
+void vectorized_banded_edit_distance(const FEMArgs *fem_args, const uint8_t *patterns, int pattern_length, const uint8_t *text, int read_length, int16_t *mapping_edit_distances, int16_t *mapping_end_positions) {
+  const uint8_t *reference_bases0 = patterns + 0 * pattern_length;
+  const uint8_t *reference_bases1 = patterns + 1 * pattern_length;
+  const uint8_t *reference_bases2 = patterns + 2 * pattern_length;
+  const uint8_t *reference_bases3 = patterns + 3 * pattern_length;
+  const uint8_t *reference_bases4 = patterns + 4 * pattern_length;
+  const uint8_t *reference_bases5 = patterns + 5 * pattern_length;
+  const uint8_t *reference_bases6 = patterns + 6 * pattern_length;
+  const uint8_t *reference_bases7 = patterns + 7 * pattern_length;
   uint16_t highest_bit_in_band_mask = 1 << (2 * fem_args->error_threshold);
   __m128i highest_bit_in_band_mask_vpu0 = _mm_set_epi16(0, 0, 0, 0, 0, 0, 0, highest_bit_in_band_mask);
   __m128i highest_bit_in_band_mask_vpu1 = _mm_set_epi16(0, 0, 0, 0, 0, 0, highest_bit_in_band_mask, 0);
@@ -178,14 +190,14 @@ void vectorized_banded_edit_distance(const FEMArgs *fem_args, const uint32_t vpu
     Peq[ai] = _mm_setzero_si128();
   }
   for (int i = 0; i < 2 * fem_args->error_threshold; i++) {
-    uint8_t base0 = char_to_uint8(reference_sequence0[i]);
-    uint8_t base1 = char_to_uint8(reference_sequence1[i]);
-    uint8_t base2 = char_to_uint8(reference_sequence2[i]);
-    uint8_t base3 = char_to_uint8(reference_sequence3[i]);
-    uint8_t base4 = char_to_uint8(reference_sequence4[i]);
-    uint8_t base5 = char_to_uint8(reference_sequence5[i]);
-    uint8_t base6 = char_to_uint8(reference_sequence6[i]);
-    uint8_t base7 = char_to_uint8(reference_sequence7[i]);
+    uint8_t base0 = reference_bases0[i];
+    uint8_t base1 = reference_bases1[i];
+    uint8_t base2 = reference_bases2[i];
+    uint8_t base3 = reference_bases3[i];
+    uint8_t base4 = reference_bases4[i];
+    uint8_t base5 = reference_bases5[i];
+    uint8_t base6 = reference_bases6[i];
+    uint8_t base7 = reference_bases7[i];
     Peq[base0] = _mm_or_si128(highest_bit_in_band_mask_vpu0, Peq[base0]);
     Peq[base1] = _mm_or_si128(highest_bit_in_band_mask_vpu1, Peq[base1]);
     Peq[base2] = _mm_or_si128(highest_bit_in_band_mask_vpu2, Peq[base2]);
@@ -211,14 +223,14 @@ void vectorized_banded_edit_distance(const FEMArgs *fem_args, const uint32_t vpu
   __m128i num_errors_at_band_start_position_vpu = _mm_setzero_si128();
   __m128i early_stop_threshold_vpu = _mm_set1_epi16(fem_args->error_threshold * 3);
   for (int i = 0; i < read_length; i++) {
-    uint8_t base0 = char_to_uint8(reference_sequence0[i + 2 * fem_args->error_threshold]);
-    uint8_t base1 = char_to_uint8(reference_sequence1[i + 2 * fem_args->error_threshold]);
-    uint8_t base2 = char_to_uint8(reference_sequence2[i + 2 * fem_args->error_threshold]);
-    uint8_t base3 = char_to_uint8(reference_sequence3[i + 2 * fem_args->error_threshold]);
-    uint8_t base4 = char_to_uint8(reference_sequence4[i + 2 * fem_args->error_threshold]);
-    uint8_t base5 = char_to_uint8(reference_sequence5[i + 2 * fem_args->error_threshold]);
-    uint8_t base6 = char_to_uint8(reference_sequence6[i + 2 * fem_args->error_threshold]);
-    uint8_t base7 = char_to_uint8(reference_sequence7[i + 2 * fem_args->error_threshold]);
+    uint8_t base0 = reference_bases0[i + 2 * fem_args->error_threshold];
+    uint8_t base1 = reference_bases1[i + 2 * fem_args->error_threshold];
+    uint8_t base2 = reference_bases2[i + 2 * fem_args->error_threshold];
+    uint8_t base3 = reference_bases3[i + 2 * fem_args->error_threshold];
+    uint8_t base4 = reference_bases4[i + 2 * fem_args->error_threshold];
+    uint8_t base5 = reference_bases5[i + 2 * fem_args->error_threshold];
+    uint8_t base6 = reference_bases6[i + 2 * fem_args->error_threshold];
+    uint8_t base7 = reference_bases7[i + 2 * fem_args->error_threshold];
     Peq[base0] = _mm_or_si128(highest_bit_in_band_mask_vpu0, Peq[base0]);
     Peq[base1] = _mm_or_si128(highest_bit_in_band_mask_vpu1, Peq[base1]);
     Peq[base2] = _mm_or_si128(highest_bit_in_band_mask_vpu2, Peq[base2]);
@@ -227,7 +239,7 @@ void vectorized_banded_edit_distance(const FEMArgs *fem_args, const uint32_t vpu
     Peq[base5] = _mm_or_si128(highest_bit_in_band_mask_vpu5, Peq[base5]);
     Peq[base6] = _mm_or_si128(highest_bit_in_band_mask_vpu6, Peq[base6]);
     Peq[base7] = _mm_or_si128(highest_bit_in_band_mask_vpu7, Peq[base7]);
-    X = _mm_or_si128(Peq[char_to_uint8(text[i])], VN);
+    X = _mm_or_si128(Peq[text[i]], VN);
     D0 = _mm_and_si128(X, VP);
     D0 = _mm_add_epi16(D0, VP);
     D0 = _mm_xor_si128(D0, VP);
@@ -276,7 +288,7 @@ void vectorized_banded_edit_distance(const FEMArgs *fem_args, const uint32_t vpu
   _mm_store_si128((__m128i *)mapping_edit_distances, min_num_errors_vpu);
 }
 
-int generate_alignment(const FEMArgs *fem_args, const char *pattern, const char *text, int read_length, int mapping_edit_distance, int mapping_end_position, kvec_t_uint32_t *cigar_uint32_t, kstring_t *MD_tag) {
+int generate_alignment(const FEMArgs *fem_args, const uint8_t *pattern, const uint8_t *text, int read_length, int mapping_edit_distance, int mapping_end_position, MappingWorkspace *workspace, kvec_t_uint32_t *cigar_uint32_t, kstring_t *MD_tag) {
   // Note that we do a semi-global alignemnt, that is, errors at two ends of ref are not penalized and read is aligned globally
   // Also note that cigar operations are on ref 
   // M/I/S/=/X operations shall equal the length of SEQ
@@ -300,11 +312,11 @@ int generate_alignment(const FEMArgs *fem_args, const char *pattern, const char
   }
 
   // Alignment traceback
-  uint32_t D0s[read_length];
-  uint32_t HPs[read_length];
+  uint32_t *D0s = workspace->D0s;
+  uint32_t *HPs = workspace->HPs;
   uint32_t Peq[5] = {0, 0, 0, 0, 0};
   for (int i = 0; i < 2 * fem_args->error_threshold; i++) {
-    uint8_t base = char_to_uint8(pattern[i]);
+    uint8_t base = pattern[i];
     Peq[base] = Peq[base] | (1 << i);
   }
   uint32_t highest_bit_in_band_mask = 1 << (2 * fem_args->error_threshold);
@@ -317,9 +329,9 @@ int generate_alignment(const FEMArgs *fem_args, const char *pattern, const char
   uint32_t HP = 0;
   //int num_errors_at_band_start_position = 0;
   for (int i = 0; i < read_length; i++) {
-    uint8_t pattern_base = char_to_uint8(pattern[i + 2 * fem_args->error_threshold]);
+    uint8_t pattern_base = pattern[i + 2 * fem_args->error_threshold];
     Peq[pattern_base] = Peq[pattern_base] | highest_bit_in_band_mask;
-    X = Peq[char_to_uint8(text[i])] | VN;
+    X = Peq[text[i]] | VN;
     D0 = ((VP + (X & VP)) ^ VP) | X;
     HN = VP & D0;
     HP = VN | ~(VP | D0);
@@ -368,8 +380,8 @@ int generate_alignment(const FEMArgs *fem_args, const char *pattern, const char
   }
 
   int cigar_operation_index = 0;
-  char cigar_operations[read_length];
-  int num_cigar_operations[read_length];
+  char *cigar_operations = workspace->cigar_operations;
+  int *num_cigar_operations = workspace->num_cigar_operations;
   while (text_position >= 0) {
     if (num_errors == mapping_edit_distance) {
       break;
@@ -498,10 +510,10 @@ int generate_alignment(const FEMArgs *fem_args, const char *pattern, const char
   return mapping_start_position;
 }
 
-void generate_MD_tag(const char *pattern, const char *text, int mapping_start_position, const kvec_t_uint32_t *cigar, kstring_t *MD_tag) {
+void generate_MD_tag(const uint8_t *pattern, const uint8_t *text, int mapping_start_position, const kvec_t_uint32_t *cigar, kstring_t *MD_tag) {
   int num_matches = 0;
-  const char *read = text;
-  const char *reference = pattern + mapping_start_position;
+  const uint8_t *read = text;
+  const uint8_t *reference = pattern + mapping_start_position;
   int read_position = 0;
   int reference_position = 0;
   for (int ci = 0; ci < kv_size(cigar->v); ci++) {
@@ -519,7 +531,7 @@ void generate_MD_tag(const char *pattern, const char *text, int mapping_start_po
             ksprintf(MD_tag, "%d", num_matches);
             num_matches = 0;
           }
-          ksprintf(MD_tag, "%c", reference[reference_position]);
+          ksprintf(MD_tag, "%c", uint8_to_char(reference[reference_position]));
         }
         ++reference_position;
         ++read_position;
@@ -533,7 +545,7 @@ void generate_MD_tag(const char *pattern, const char *text, int mapping_start_po
       }
       ksprintf(MD_tag, "%c", '^');
       for (int opi = 0; opi < num_cigar_operations; opi++) {
-        ksprintf(MD_tag, "%c", reference[reference_position]);
+        ksprintf(MD_tag, "%c", uint8_to_char(reference[reference_position]));
         reference_position++;
       }
     }
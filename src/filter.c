@@ -1,12 +1,15 @@
 #include "filter.h"
 
-uint32_t generate_optimal_prefix_qgram_for_group_seeding(const FEMArgs *fem_args, const Index *index, int seed_length, int read_length, Seed *seeds, Seed *optimal_seeds) {
+#include "ksort.h"
+
+uint32_t generate_optimal_prefix_qgram_for_group_seeding(const FEMArgs *fem_args, const Index *index, int seed_length, int read_length, Seed *seeds, MappingWorkspace *workspace, Seed *optimal_seeds) {
   uint32_t num_rows = fem_args->error_threshold + fem_args->num_additional_qgrams + 1 + 1;
   uint32_t num_columns = read_length - (fem_args->error_threshold + fem_args->num_additional_qgrams + 1) * seed_length + 1 + 1; // check if reduce d by one
-  uint32_t M[num_rows][num_columns];
-  uint32_t D[num_rows][num_columns]; // 3 for stop, 2 for vertical move and 1 for horizontal move
+  // Row-major num_rows x num_columns matrices from the workspace
+  uint32_t (*M)[num_columns] = (uint32_t (*)[num_columns])workspace->dp_occurrences;
+  uint8_t (*D)[num_columns] = (uint8_t (*)[num_columns])workspace->dp_moves; // 3 for stop, 2 for vertical move and 1 for horizontal move
   for (uint32_t i = 1; i < num_rows; ++i) {
-    M[i][0] = index->occurrence_table_size; 
+    M[i][0] = index->occurrence_table_size + index->repeat_occurrence_table_size; 
     D[i][0] = 3;
   }
   for (uint32_t i = 1; i < num_columns; ++i) {
@@ -77,42 +80,297 @@ void merge_kvec_t_uint64_t(const FEMArgs *fem_args, kvec_t_uint64_t *buffer1, kv
   }
 }
 
-void merge_candidate_locations(const FEMArgs *fem_args, const Index *index, const Seed *seeds, size_t num_seeds, kvec_t_uint64_t *buffer1, kvec_t_uint64_t *buffer2) {
-  for (size_t si = 0; si < num_seeds; ++si) {
-    size_t buffer1_index = 0;
-    size_t seed_occurrence_index = 0;
-    uint64_t *seed_occurrence_list = get_seed_occurrences(index, seeds[si].hash_value);
-    while (buffer1_index < kv_size(buffer1->v) || (si != num_seeds - 1 && seed_occurrence_index < seeds[si].num_positions)) { // TODO: for the second case I have to push back one extra
-      if (buffer1_index < kv_size(buffer1->v)) {
-        uint64_t buffer1_position = kv_A(buffer1->v, buffer1_index);
-        if (seed_occurrence_index < seeds[si].num_positions) {
-          if ((uint32_t)seed_occurrence_list[seed_occurrence_index] < seeds[si].start_position) {
-            ++seed_occurrence_index;
-          } else {
-            uint64_t seed_position = seed_occurrence_list[seed_occurrence_index] - seeds[si].start_position;
-            if (seed_position <= buffer1_position) {
-              kv_push(uint64_t, buffer2->v, seed_position);
-              ++seed_occurrence_index;
-            } else {
-              kv_push(uint64_t, buffer2->v, buffer1_position);
-              ++buffer1_index;
-            }
-          }
-        } else {
-          kv_push(uint64_t, buffer2->v, buffer1_position);
-          ++buffer1_index;
+// The sorted candidate locations of one seed: its occurrences at or after the
+// seed's offset in the read, less that offset.
+typedef struct {
+  const uint64_t *occurrences;
+  const uint64_t *occurrences_end;
+  uint32_t start_position;
+} CandidateLocationRun;
+
+// Up to 7 errors and 2 additional q-grams make 10 seeds, the leaves of a tree of 16.
+#define MAX_NUM_MERGED_RUNS 16
+// Sorts after any location, so an exhausted run never wins.
+#define EXHAUSTED_RUN_LOCATION UINT64_MAX
+
+// Sets up the run of a seed, whose compact occurrences are decoded into
+// occurrence_buffer.
+static void get_candidate_location_run(const Index *index, const Seed *seed, kvec_t_uint64_t *occurrence_buffer, CandidateLocationRun *run) {
+  const uint64_t *seed_occurrence_list = seed->num_positions > 0 ? get_seed_occurrences(index, seed->hash_value, occurrence_buffer) : NULL;
+  uint32_t num_seed_occurrences = seed_occurrence_list == NULL ? 0 : seed->num_positions;
+  // A canonical bucket holds both strands, and the seed matches only one of them.
+  if (index->canonical_seeds && num_seed_occurrences > 0) {
+    uint32_t num_forward_strand_occurrences = get_num_forward_strand_occurrences(seed_occurrence_list, num_seed_occurrences);
+    if (seed->is_reverse_strand) {
+      seed_occurrence_list += num_forward_strand_occurrences;
+      num_seed_occurrences -= num_forward_strand_occurrences;
+    } else {
+      num_seed_occurrences = num_forward_strand_occurrences;
+    }
+  }
+  run->occurrences = seed_occurrence_list;
+  run->occurrences_end = seed_occurrence_list + num_seed_occurrences;
+  run->start_position = seed->start_position;
+}
+
+static inline uint64_t pop_candidate_location(CandidateLocationRun *run) {
+  while (run->occurrences < run->occurrences_end) {
+    uint64_t occurrence = *(run->occurrences++);
+    if ((uint32_t)occurrence >= run->start_position) {
+      return (occurrence & ~INDEX_OCCURRENCE_REVERSE_STRAND) - run->start_position;
+    }
+  }
+  return EXHAUSTED_RUN_LOCATION;
+}
+
+// Merges the candidate locations of the seeds, sorted on their frequency, into
+// candidate_locations in one pass over a tournament tree of losers. Each inner
+// node keeps the run that lost the match there, so replacing the winner only
+// replays its path to the root, one compare and two conditional moves per
+// level. Compact occurrence tables are decoded into one buffer per seed, as
+// all the runs are read at once. The locations of the most frequent seed are
+// only taken up to the last location of the other seeds.
+void merge_candidate_locations(const FEMArgs *fem_args, const Index *index, const Seed *seeds, size_t num_seeds, kvec_t_uint64_t *occurrence_buffers, kvec_t_uint64_t *candidate_locations) {
+  assert(num_seeds > 0 && num_seeds <= MAX_NUM_MERGED_RUNS);
+  size_t num_leaves = 1;
+  while (num_leaves < num_seeds) {
+    num_leaves <<= 1;
+  }
+  CandidateLocationRun runs[MAX_NUM_MERGED_RUNS];
+  size_t num_occurrences = 0;
+  for (size_t si = 0; si < num_leaves; ++si) {
+    if (si < num_seeds) {
+      get_candidate_location_run(index, seeds + si, occurrence_buffers + si, runs + si);
+    } else {
+      runs[si].occurrences = NULL;
+      runs[si].occurrences_end = NULL;
+      runs[si].start_position = 0;
+    }
+  }
+  // Cut the last run after the largest location of the others.
+  uint64_t max_location = 0;
+  int has_location = 0;
+  for (size_t si = 0; si + 1 < num_seeds; ++si) {
+    for (const uint64_t *occurrence = runs[si].occurrences_end; occurrence > runs[si].occurrences; --occurrence) {
+      if ((uint32_t)occurrence[-1] >= runs[si].start_position) {
+        uint64_t location = (occurrence[-1] & ~INDEX_OCCURRENCE_REVERSE_STRAND) - runs[si].start_position;
+        if (!has_location || location > max_location) {
+          max_location = location;
         }
+        has_location = 1;
+        break;
+      }
+    }
+  }
+  CandidateLocationRun *last_run = runs + num_seeds - 1;
+  if (!has_location) {
+    last_run->occurrences_end = last_run->occurrences;
+  } else {
+    uint64_t max_occurrence = max_location + last_run->start_position;
+    const uint64_t *low = last_run->occurrences;
+    const uint64_t *high = last_run->occurrences_end;
+    while (low < high) {
+      const uint64_t *middle = low + (high - low) / 2;
+      if ((*middle & ~INDEX_OCCURRENCE_REVERSE_STRAND) <= max_occurrence) {
+        low = middle + 1;
       } else {
-        if ((uint32_t)seed_occurrence_list[seed_occurrence_index] >= seeds[si].start_position) {
-          uint64_t seed_position = seed_occurrence_list[seed_occurrence_index] - seeds[si].start_position;
-          kv_push(uint64_t, buffer2->v, seed_position);
+        high = middle;
+      }
+    }
+    last_run->occurrences_end = low;
+  }
+  uint64_t heads[MAX_NUM_MERGED_RUNS];
+  for (size_t si = 0; si < num_leaves; ++si) {
+    num_occurrences += runs[si].occurrences_end - runs[si].occurrences;
+    heads[si] = pop_candidate_location(runs + si);
+  }
+  // Play the first round bottom up. Node i has children 2i and 2i + 1, and
+  // leaf j is node num_leaves + j. losers[0] holds the overall winner.
+  int losers[MAX_NUM_MERGED_RUNS];
+  int winners[2 * MAX_NUM_MERGED_RUNS];
+  for (size_t si = 0; si < num_leaves; ++si) {
+    winners[num_leaves + si] = si;
+  }
+  for (size_t node = num_leaves - 1; node > 0; --node) {
+    int left = winners[2 * node];
+    int right = winners[2 * node + 1];
+    int left_wins = heads[left] <= heads[right];
+    winners[node] = left_wins ? left : right;
+    losers[node] = left_wins ? right : left;
+  }
+  losers[0] = winners[1];
+  if (kv_max(candidate_locations->v) < num_occurrences) {
+    kv_resize(uint64_t, candidate_locations->v, num_occurrences);
+  }
+  uint64_t *locations = candidate_locations->v.a;
+  size_t num_locations = 0;
+  int winner = losers[0];
+  uint64_t location = heads[winner];
+  while (location != EXHAUSTED_RUN_LOCATION) {
+    locations[num_locations++] = location;
+    heads[winner] = pop_candidate_location(runs + winner);
+    for (size_t node = (num_leaves + winner) >> 1; node > 0; node >>= 1) {
+      int loser = losers[node];
+      int loser_wins = heads[loser] < heads[winner];
+      losers[node] = loser_wins ? winner : loser;
+      winner = loser_wins ? loser : winner;
+    }
+    location = heads[winner];
+  }
+  kv_size(candidate_locations->v) = num_locations;
+}
+
+#define CandidateLocationSortKey(m) (m)
+KRADIX_SORT_INIT(candidate_location, uint64_t, CandidateLocationSortKey, 8);
+
+// Open addressing over the diagonal bins of a seed group, keyed on bin + 1 so
+// that 0 marks an empty slot.
+static inline size_t find_vote_slot(const uint64_t *vote_bins, size_t slot_mask, uint64_t key) {
+  size_t slot = ((key * 0x9e3779b97f4a7c15ULL) >> 32) & slot_mask;
+  while (vote_bins[slot] != key && vote_bins[slot] != 0) {
+    slot = (slot + 1) & slot_mask;
+  }
+  return slot;
+}
+
+static inline uint32_t get_num_votes(const uint64_t *vote_bins, const uint32_t *vote_counts, size_t slot_mask, uint64_t key) {
+  if (key == 0) {
+    return 0;
+  }
+  size_t slot = find_vote_slot(vote_bins, slot_mask, key);
+  return vote_bins[slot] == key ? vote_counts[slot] : 0;
+}
+
+// Puts the candidate locations of the seeds that can pass the additional
+// q-gram filter into candidate_locations, sorted. Instead of merging all the
+// locations, each one votes for its diagonal bin in a table of the seed
+// group, and only the locations whose bin, with one of its neighbors, has
+// more than num_additional_qgrams votes are kept and sorted. A bin is the
+// smallest power of two of at least error_threshold + 1 locations, so the
+// locations within error_threshold of a candidate fall into one bin or two
+// adjacent ones, and the filter keeps the same candidates as with all the
+// locations. Unlike the merge, all locations of the most frequent seed vote.
+void vote_candidate_locations(const FEMArgs *fem_args, const Index *index, const Seed *seeds, size_t num_seeds, kvec_t_uint64_t *occurrence_buffers, kvec_t_uint64_t *vote_bins, kvec_t_uint32_t *vote_counts, kvec_t_uint64_t *candidate_locations) {
+  assert(num_seeds > 0 && num_seeds <= MAX_NUM_MERGED_RUNS);
+  CandidateLocationRun runs[MAX_NUM_MERGED_RUNS];
+  size_t num_occurrences = 0;
+  for (size_t si = 0; si < num_seeds; ++si) {
+    get_candidate_location_run(index, seeds + si, occurrence_buffers + si, runs + si);
+    num_occurrences += runs[si].occurrences_end - runs[si].occurrences;
+  }
+  kv_clear(candidate_locations->v);
+  if (num_occurrences == 0) {
+    return;
+  }
+  int bin_shift = 0;
+  while ((1 << bin_shift) < fem_args->error_threshold + 1) {
+    ++bin_shift;
+  }
+  // At most half full
+  size_t num_slots = 16;
+  while (num_slots < 2 * num_occurrences) {
+    num_slots <<= 1;
+  }
+  if (kv_max(vote_bins->v) < num_slots) {
+    kv_resize(uint64_t, vote_bins->v, num_slots);
+    kv_resize(uint32_t, vote_counts->v, num_slots);
+  }
+  uint64_t *bins = vote_bins->v.a;
+  uint32_t *counts = vote_counts->v.a;
+  size_t slot_mask = num_slots - 1;
+  memset(bins, 0, sizeof(uint64_t) * num_slots);
+  for (size_t si = 0; si < num_seeds; ++si) {
+    CandidateLocationRun run = runs[si];
+    for (uint64_t location = pop_candidate_location(&run); location != EXHAUSTED_RUN_LOCATION; location = pop_candidate_location(&run)) {
+      uint64_t key = (location >> bin_shift) + 1;
+      size_t slot = find_vote_slot(bins, slot_mask, key);
+      if (bins[slot] == 0) {
+        bins[slot] = key;
+        counts[slot] = 0;
+      }
+      ++counts[slot];
+    }
+  }
+  uint32_t num_additional_qgrams = fem_args->num_additional_qgrams;
+  for (size_t si = 0; si < num_seeds; ++si) {
+    CandidateLocationRun run = runs[si];
+    for (uint64_t location = pop_candidate_location(&run); location != EXHAUSTED_RUN_LOCATION; location = pop_candidate_location(&run)) {
+      uint64_t key = (location >> bin_shift) + 1;
+      uint32_t num_votes = get_num_votes(bins, counts, slot_mask, key);
+      if (num_votes + get_num_votes(bins, counts, slot_mask, key - 1) > num_additional_qgrams || num_votes + get_num_votes(bins, counts, slot_mask, key + 1) > num_additional_qgrams) {
+        kv_push(uint64_t, candidate_locations->v, location);
+      }
+    }
+  }
+  radix_sort_candidate_location(candidate_locations->v.a, candidate_locations->v.a + kv_size(candidate_locations->v));
+}
+
+// Returns the first occurrence from occurrence on whose location, without the
+// strand bit, is at least target. The step doubles until it passes target,
+// and the last step is then searched in halves, so skipping n occurrences
+// takes about 2 log n probes.
+static inline const uint64_t *gallop_to_occurrence(const uint64_t *occurrence, const uint64_t *occurrences_end, uint64_t target) {
+  if (occurrence >= occurrences_end || (*occurrence & ~INDEX_OCCURRENCE_REVERSE_STRAND) >= target) {
+    return occurrence;
+  }
+  size_t step = 1;
+  while (occurrence + step < occurrences_end && (occurrence[step] & ~INDEX_OCCURRENCE_REVERSE_STRAND) < target) {
+    step <<= 1;
+  }
+  const uint64_t *low = occurrence + step / 2 + 1;
+  const uint64_t *high = occurrence + step < occurrences_end ? occurrence + step : occurrences_end;
+  while (low < high) {
+    const uint64_t *middle = low + (high - low) / 2;
+    if ((*middle & ~INDEX_OCCURRENCE_REVERSE_STRAND) < target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Puts the candidate locations of the seeds that can pass the additional
+// q-gram filter into candidate_locations, sorted. More than
+// num_additional_qgrams locations from different seeds include one of the
+// error_threshold + 1 least frequent seeds, so only their locations are
+// taken in full. The num_additional_qgrams most frequent seeds are then only
+// probed within error_threshold of those locations, galloping through their
+// occurrences, and the cost follows the small lists rather than the large
+// ones. Candidates that only the frequent seeds support, which takes two of
+// their locations within error_threshold, are not found.
+void intersect_candidate_locations(const FEMArgs *fem_args, const Index *index, const Seed *seeds, size_t num_seeds, kvec_t_uint64_t *occurrence_buffers, kvec_t_uint64_t *candidate_locations) {
+  assert(num_seeds > 0 && num_seeds <= MAX_NUM_MERGED_RUNS);
+  size_t num_probe_seeds = fem_args->error_threshold + 1;
+  uint64_t error_threshold = fem_args->error_threshold;
+  kv_clear(candidate_locations->v);
+  for (size_t si = 0; si < num_probe_seeds && si < num_seeds; ++si) {
+    CandidateLocationRun run;
+    get_candidate_location_run(index, seeds + si, occurrence_buffers + si, &run);
+    for (uint64_t location = pop_candidate_location(&run); location != EXHAUSTED_RUN_LOCATION; location = pop_candidate_location(&run)) {
+      kv_push(uint64_t, candidate_locations->v, location);
+    }
+  }
+  size_t num_probes = kv_size(candidate_locations->v);
+  radix_sort_candidate_location(candidate_locations->v.a, candidate_locations->v.a + num_probes);
+  // The probes are visited in order and the cursor only moves forward, so
+  // each location of a frequent seed is added at most once.
+  for (size_t si = num_probe_seeds; si < num_seeds && num_probes > 0; ++si) {
+    CandidateLocationRun run;
+    get_candidate_location_run(index, seeds + si, occurrence_buffers + si, &run);
+    const uint64_t *occurrence = run.occurrences;
+    for (size_t pi = 0; pi < num_probes && occurrence < run.occurrences_end; ++pi) {
+      uint64_t probe = kv_A(candidate_locations->v, pi);
+      uint64_t min_location = probe > error_threshold ? probe - error_threshold : 0;
+      occurrence = gallop_to_occurrence(occurrence, run.occurrences_end, min_location + run.start_position);
+      for (; occurrence < run.occurrences_end && (*occurrence & ~INDEX_OCCURRENCE_REVERSE_STRAND) <= probe + error_threshold + run.start_position; ++occurrence) {
+        if ((uint32_t)*occurrence >= run.start_position) {
+          kv_push(uint64_t, candidate_locations->v, (*occurrence & ~INDEX_OCCURRENCE_REVERSE_STRAND) - run.start_position);
         }
-        ++seed_occurrence_index;
       }
     }
-    kv_swap(uint64_t, buffer1->v, buffer2->v);
-    kv_clear(buffer2->v);
   }
+  radix_sort_candidate_location(candidate_locations->v.a, candidate_locations->v.a + kv_size(candidate_locations->v));
 }
 
 void additional_qgram_filter(const FEMArgs *fem_args, kvec_t_uint64_t *buffer, kvec_t_uint64_t *candidates) {
@@ -143,11 +401,61 @@ void remove_out_ranged_candidates(const FEMArgs *fem_args, uint32_t read_length,
   }
 }
 
-uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, size_t read_index, uint8_t direction, const SequenceBatch *reference_sequence_batch, const Index *index, kvec_t_uint64_t *buffer1, kvec_t_uint64_t *buffer2, kvec_t_uint64_t *candidates, uint32_t *num_candidates_without_additonal_qgram_filter) {
+// Fills in the seed at a position of the read. Its frequency is looked up once
+// and kept in seed_frequencies at frequency_index.
+static inline void set_read_seed(const FEMArgs *fem_args, const Index *index, const uint64_t *seed_hash_values, const uint8_t *seed_is_ambiguous, const uint8_t *seed_is_reverse_strand, int seed_index_in_read, uint32_t *seed_frequencies, int frequency_index, Seed *seed) {
+  seed->hash_value = seed_hash_values[seed_index_in_read];
+  seed->start_position = seed_index_in_read;
+  seed->end_position = seed_index_in_read + fem_args->kmer_size;
+  seed->is_reverse_strand = index->canonical_seeds && seed_is_reverse_strand[seed_index_in_read];
+  if (index->skip_ambiguous_seeds && seed_is_ambiguous[seed_index_in_read]) {
+    seed->num_positions = 0;
+  } else {
+    if (seed_frequencies[frequency_index] == UINT32_MAX) {
+      seed_frequencies[frequency_index] = get_seed_frequency(index, seed->hash_value);
+    }
+    seed->num_positions = seed_frequencies[frequency_index];
+  }
+}
+
+// Adds the candidates of a seed group, given its optimal seeds, to the
+// candidates of the workspace.
+static void add_seed_group_candidates(const FEMArgs *fem_args, const Index *index, Seed *optimal_seeds, MappingWorkspace *workspace) {
+  kvec_t_uint64_t *buffer1 = &(workspace->buffer1);
+  kvec_t_uint64_t *buffer2 = &(workspace->buffer2);
+  kvec_t_uint64_t *candidates = &(workspace->candidates);
+  int num_optimal_seeds = fem_args->error_threshold + 1 + fem_args->num_additional_qgrams;
+  // Sort q-grams on their frequency
+  qsort(optimal_seeds, num_optimal_seeds, sizeof(Seed), compare_seed);
+  // The most frequent optimal seed is last, so it tells whether the seed group needs a repeat.
+  if (fem_args->repeat_policy == REPEAT_POLICY_SKIP && is_repeat_seed_frequency(index, optimal_seeds[num_optimal_seeds - 1].num_positions)) {
+    return;
+  }
+  // Filter seeds with additional q-gram
+  kv_clear(buffer1->v);
+  kv_clear(buffer2->v);
+  if (fem_args->filter_engine == FILTER_ENGINE_VOTE) {
+    vote_candidate_locations(fem_args, index, optimal_seeds, num_optimal_seeds, workspace->occurrence_buffers, &(workspace->vote_bins), &(workspace->vote_counts), buffer1);
+  } else if (fem_args->filter_engine == FILTER_ENGINE_GALLOP) {
+    intersect_candidate_locations(fem_args, index, optimal_seeds, num_optimal_seeds, workspace->occurrence_buffers, buffer1);
+  } else {
+    merge_candidate_locations(fem_args, index, optimal_seeds, num_optimal_seeds, workspace->occurrence_buffers, buffer1);
+  }
+  additional_qgram_filter(fem_args, buffer1, buffer2);
+  kv_swap(uint64_t, buffer1->v, candidates->v);
+  kv_clear(candidates->v);
+  merge_kvec_t_uint64_t(fem_args, buffer1, buffer2, candidates);
+}
+
+uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, size_t read_index, uint8_t direction, const SequenceBatch *reference_sequence_batch, const Index *index, uint32_t max_num_occurrences, MappingWorkspace *workspace, uint32_t *num_candidates_without_additonal_qgram_filter) {
   //const uint8_t *bases = read->bases;
   //if (is_reverse_complement == 1) {
   //  bases = read->rc_bases;
   //}
+  kvec_t_uint64_t *buffer1 = &(workspace->buffer1);
+  kvec_t_uint64_t *buffer2 = &(workspace->buffer2);
+  kvec_t_uint64_t *candidates = &(workspace->candidates);
+  kvec_t_uint32_t *seed_frequencies = &(workspace->seed_frequencies);
   kv_clear(buffer1->v);
   kv_clear(buffer2->v);
   kv_clear(candidates->v);
@@ -157,6 +465,7 @@ uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const Sequen
   if (direction == NEGATIVE_DIRECTION) {
     read_sequence = get_negative_sequence_from_sequence_batch_at(read_sequence_batch, read_index);
   }
+  reserve_mapping_workspace(fem_args, read_length, workspace);
 
   // Check if we can select enough seeds in the read
   int seed_length_in_seed_group = fem_args->kmer_size / fem_args->step_size;
@@ -165,21 +474,59 @@ uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const Sequen
   }
   int num_seeds_in_read = (int)read_length - fem_args->kmer_size + 1;
   assert(num_seeds_in_read > 0);
-  int min_num_seeds_in_seed_group = num_seeds_in_read / fem_args->step_size;
-  if (fem_args->error_threshold + 1 + fem_args->num_additional_qgrams > min_num_seeds_in_seed_group) {
-    // read is too short to be mapped
-    return 0;
+  // Seed frequencies are looked up on demand. In a canonical index the seed at
+  // position i of the negative strand shares its bucket with the seed at
+  // num_seeds_in_read - 1 - i of the positive strand, so the frequencies
+  // looked up for the positive strand are kept for the negative one.
+  int reuses_seed_frequencies = index->canonical_seeds && direction == NEGATIVE_DIRECTION;
+  if (!reuses_seed_frequencies) {
+    kv_resize(uint32_t, seed_frequencies->v, num_seeds_in_read);
+    memset(seed_frequencies->v.a, 0xff, sizeof(uint32_t) * num_seeds_in_read);
+  }
+  int num_optimal_seeds = fem_args->error_threshold + 1 + fem_args->num_additional_qgrams;
+  // With minimizers, step_size is the window size w. Each window of w seeds
+  // offers its minimizer as a seed, and an error in the w + k - 1 bases of a
+  // window can change its minimizer, so the windows of the optimal seeds must
+  // not overlap.
+  int minimizer_window_span = fem_args->step_size + fem_args->kmer_size - 1;
+  int num_minimizer_windows = (int)read_length - minimizer_window_span + 1;
+  if (index->minimizer_seeds) {
+    if (num_optimal_seeds * minimizer_window_span > num_minimizer_windows) {
+      return 0;
+    }
+  } else {
+    int min_num_seeds_in_seed_group = (num_seeds_in_read - fem_args->step_size + 1) / fem_args->step_size;
+    // The q-grams of a seed group must not overlap, which long windows can rule out.
+    if (num_optimal_seeds * seed_length_in_seed_group > min_num_seeds_in_seed_group) {
+      // read is too short to be mapped
+      return 0;
+    }
   }
 
   // dp for seed selection start
   // Generate seeds
-  uint32_t seed_hash_values[num_seeds_in_read];
+  uint64_t *seed_hash_values = workspace->seed_hash_values;
   //uint32_t seed_frequencies[num_seeds_in_read];
   int num_seeds_with_ambiguous_base = 0;
   hash_all_seeds_in_sequence(0, num_seeds_in_read, fem_args->kmer_size, read_sequence, read_length, &num_seeds_with_ambiguous_base, seed_hash_values);
   if (num_seeds_with_ambiguous_base > fem_args->error_threshold) {
     return 0;
   }
+  // A seed that overlaps an N cannot match an index without such seeds, and
+  // it already holds one of the errors, so it is selected as a seed without
+  // any occurrence.
+  uint8_t *seed_is_ambiguous = workspace->seed_is_ambiguous;
+  if (index->skip_ambiguous_seeds) {
+    mark_seeds_with_ambiguous_base(num_seeds_in_read, fem_args->kmer_size, read_sequence, seed_is_ambiguous);
+  }
+  uint8_t *seed_is_reverse_strand = workspace->seed_is_reverse_strand;
+  if (index->canonical_seeds) {
+    for (int i = 0; i < num_seeds_in_read; ++i) {
+      uint64_t canonical_hash_value = get_canonical_seed(seed_hash_values[i], fem_args->kmer_size);
+      seed_is_reverse_strand[i] = canonical_hash_value != seed_hash_values[i];
+      seed_hash_values[i] = canonical_hash_value;
+    }
+  }
   //for (int si = 0; si < num_seeds_in_read; ++si) {
   //  seed_frequencies[si] = index->lookup_table[seed_hash_values[si] + 1] - lookup_table[seed_hash_values[si]];
   //}
@@ -187,29 +534,55 @@ uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const Sequen
   // Run seeding algorithm in each seed group
   *num_candidates_without_additonal_qgram_filter = 0;
   //uint32_t num_candidates = 0;
-  for (int si = 0; si < fem_args->step_size; ++si) {
-    // Generate optimal prefix q-gram
-    int num_seeds_in_current_seed_group = (read_length - fem_args->kmer_size + 1 - si) / fem_args->step_size;
-    Seed seeds_in_current_seed_group[num_seeds_in_current_seed_group];
-    Seed optimal_seeds_in_current_seed_group[fem_args->error_threshold + 1 + fem_args->num_additional_qgrams];
-    for (int k = 0; k < num_seeds_in_current_seed_group; ++k) {
-      int seed_index_in_read = si + k * fem_args->step_size;
-      seeds_in_current_seed_group[k].hash_value = seed_hash_values[seed_index_in_read];
-      seeds_in_current_seed_group[k].start_position = seed_index_in_read;
-      seeds_in_current_seed_group[k].end_position = seed_index_in_read + fem_args->kmer_size;
-      seeds_in_current_seed_group[k].num_positions = get_seed_frequency(index, seeds_in_current_seed_group[k].hash_value);
-    }
-    *num_candidates_without_additonal_qgram_filter += generate_optimal_prefix_qgram_for_group_seeding(fem_args, index, seed_length_in_seed_group, num_seeds_in_current_seed_group, seeds_in_current_seed_group, optimal_seeds_in_current_seed_group);
-    // Sort q-grams on their frequency
-    qsort(optimal_seeds_in_current_seed_group, fem_args->error_threshold + 1 + fem_args->num_additional_qgrams, sizeof(Seed), compare_seed);
-    // Filter seeds with additional q-gram
-    kv_clear(buffer1->v);
-    kv_clear(buffer2->v);
-    merge_candidate_locations(fem_args, index, optimal_seeds_in_current_seed_group, fem_args->error_threshold + 1 + fem_args->num_additional_qgrams, buffer1, buffer2);
-    additional_qgram_filter(fem_args, buffer1, buffer2);
-    kv_swap(uint64_t, buffer1->v, candidates->v);
-    kv_clear(candidates->v);
-    merge_kvec_t_uint64_t(fem_args, buffer1, buffer2, candidates);
+  if (index->minimizer_seeds) {
+    // A single seed group: the minimizer of each window, found with a deque
+    // of increasing orders. The optimal seeds come from windows that are
+    // minimizer_window_span apart, just as those of a step group are
+    // seed_length_in_seed_group seeds apart.
+    uint64_t *seed_orders = workspace->seed_orders;
+    for (int i = 0; i < num_seeds_in_read; ++i) {
+      seed_orders[i] = get_minimizer_order(seed_hash_values[i], fem_args->kmer_size);
+    }
+    int *deque = workspace->minimizer_deque;
+    int deque_front = 0;
+    int deque_back = 0;
+    Seed *window_minimizers = workspace->seeds;
+    Seed *optimal_seeds = workspace->optimal_seeds;
+    for (int i = 0; i < num_seeds_in_read; ++i) {
+      while (deque_back > deque_front && seed_orders[deque[deque_back - 1]] > seed_orders[i]) {
+        --deque_back;
+      }
+      deque[deque_back++] = i;
+      if (deque[deque_front] + fem_args->step_size <= i) {
+        ++deque_front;
+      }
+      if (i + 1 >= fem_args->step_size) {
+        int seed_index_in_read = deque[deque_front];
+        set_read_seed(fem_args, index, seed_hash_values, seed_is_ambiguous, seed_is_reverse_strand, seed_index_in_read, seed_frequencies->v.a, reuses_seed_frequencies ? num_seeds_in_read - 1 - seed_index_in_read : seed_index_in_read, window_minimizers + i + 1 - fem_args->step_size);
+      }
+    }
+    *num_candidates_without_additonal_qgram_filter += generate_optimal_prefix_qgram_for_group_seeding(fem_args, index, minimizer_window_span, num_minimizer_windows, window_minimizers, workspace, optimal_seeds);
+    if (*num_candidates_without_additonal_qgram_filter > max_num_occurrences) {
+      return 0;
+    }
+    add_seed_group_candidates(fem_args, index, optimal_seeds, workspace);
+  } else {
+    for (int si = 0; si < fem_args->step_size; ++si) {
+      // Generate optimal prefix q-gram
+      int num_seeds_in_current_seed_group = (read_length - fem_args->kmer_size + 1 - si) / fem_args->step_size;
+      Seed *seeds_in_current_seed_group = workspace->seeds;
+      Seed *optimal_seeds_in_current_seed_group = workspace->optimal_seeds;
+      for (int k = 0; k < num_seeds_in_current_seed_group; ++k) {
+        int seed_index_in_read = si + k * fem_args->step_size;
+        set_read_seed(fem_args, index, seed_hash_values, seed_is_ambiguous, seed_is_reverse_strand, seed_index_in_read, seed_frequencies->v.a, reuses_seed_frequencies ? num_seeds_in_read - 1 - seed_index_in_read : seed_index_in_read, seeds_in_current_seed_group + k);
+      }
+      *num_candidates_without_additonal_qgram_filter += generate_optimal_prefix_qgram_for_group_seeding(fem_args, index, seed_length_in_seed_group, num_seeds_in_current_seed_group, seeds_in_current_seed_group, workspace, optimal_seeds_in_current_seed_group);
+      // Over the budget, the remaining seed groups are not looked up at all.
+      if (*num_candidates_without_additonal_qgram_filter > max_num_occurrences) {
+        return 0;
+      }
+      add_seed_group_candidates(fem_args, index, optimal_seeds_in_current_seed_group, workspace);
+    }
   }
   for (size_t i = 1; i < kv_size(candidates->v); ++i) {
     if (kv_A(candidates->v, i - 1) == kv_A(candidates->v, i)) {
@@ -3,9 +3,16 @@
 
 #include "index.h"
 #include "kvec.h"
+#include "mapping_workspace.h"
 #include "sequence_batch.h"
 #include "utils.h"
 
-uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, size_t read_index, uint8_t direction, const SequenceBatch *reference_sequence_batch, const Index *index, kvec_t_uint64_t *buffer1, kvec_t_uint64_t *buffer2, kvec_t_uint64_t *candidates, uint32_t *num_candidates_without_additonal_qgram_filter);
+// How the candidate locations of a seed group are gathered before the
+// additional q-gram filter.
+#define FILTER_ENGINE_MERGE 0 // merge the sorted locations of all the seeds
+#define FILTER_ENGINE_VOTE 1 // count the locations per diagonal bin and sort only those in bins with enough votes
+#define FILTER_ENGINE_GALLOP 2 // probe the most frequent seeds only near the locations of the others
+
+uint32_t generate_group_seeding_candidates(const FEMArgs *fem_args, const SequenceBatch *read_sequence_batch, size_t read_index, uint8_t direction, const SequenceBatch *reference_sequence_batch, const Index *index, uint32_t max_num_occurrences, MappingWorkspace *workspace, uint32_t *num_candidates_without_additonal_qgram_filter);
 
 #endif // FILTER_H_
@@ -1,24 +1,835 @@
 #include "index.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 #include "ksort.h"
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+// Number of data bytes and the byte shuffle that spreads them over four
+// 32-bit lanes, for every StreamVByte control byte.
+static uint8_t streamvbyte_lengths[256];
+static uint8_t streamvbyte_shuffle_masks[256][16];
+
+static void initialize_streamvbyte_tables() {
+  for (int control = 0; control < 256; ++control) {
+    uint8_t length = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+      int num_bytes = ((control >> (2 * lane)) & 3) + 1;
+      for (int byte = 0; byte < 4; ++byte) {
+        streamvbyte_shuffle_masks[control][4 * lane + byte] = byte < num_bytes ? length + byte : 0x80;
+      }
+      length += num_bytes;
+    }
+    streamvbyte_lengths[control] = length;
+  }
+}
+
+// Sets the parameters and array sizes of an Elias-Fano sequence. The low bits
+// are padded with one word so that a value can always be read with two loads.
+static void initialize_elias_fano_sequence(uint64_t num_values, uint64_t universe, EliasFanoSequence *sequence) {
+  sequence->num_values = num_values;
+  sequence->universe = universe;
+  sequence->num_low_bits = 0;
+  while (num_values > 0 && (universe / num_values) >> (sequence->num_low_bits + 1) > 0) {
+    ++sequence->num_low_bits;
+  }
+  sequence->num_low_bit_words = sequence->num_low_bits == 0 ? 0 : (num_values * sequence->num_low_bits + 63) / 64 + 1;
+  sequence->num_high_bit_words = (num_values + (universe >> sequence->num_low_bits) + 1 + 63) / 64;
+  sequence->num_select_samples = (num_values + ELIAS_FANO_SELECT_SAMPLE_RATE - 1) / ELIAS_FANO_SELECT_SAMPLE_RATE;
+  sequence->low_bits = NULL;
+  sequence->high_bits = NULL;
+  sequence->select_samples = NULL;
+  sequence->sparse_select_positions = NULL;
+  sequence->num_sparse_select_positions = 0;
+}
+
+static void destroy_elias_fano_sequence(EliasFanoSequence *sequence) {
+  if (sequence->low_bits != NULL) {
+    free(sequence->low_bits);
+    sequence->low_bits = NULL;
+  }
+  if (sequence->high_bits != NULL) {
+    free(sequence->high_bits);
+    sequence->high_bits = NULL;
+  }
+  if (sequence->select_samples != NULL) {
+    free(sequence->select_samples);
+    sequence->select_samples = NULL;
+  }
+  if (sequence->sparse_select_positions != NULL) {
+    free(sequence->sparse_select_positions);
+    sequence->sparse_select_positions = NULL;
+  }
+}
+
+static inline size_t get_elias_fano_sequence_size_in_bytes(const EliasFanoSequence *sequence) {
+  return sizeof(uint64_t) * (sequence->num_low_bit_words + sequence->num_high_bit_words + sequence->num_select_samples + sequence->num_sparse_select_positions);
+}
+
+// Encodes a non-decreasing sequence whose last value is the largest.
+static void construct_elias_fano_sequence(const uint32_t *values, uint64_t num_values, EliasFanoSequence *sequence) {
+  initialize_elias_fano_sequence(num_values, values[num_values - 1], sequence);
+  if (sequence->num_low_bit_words > 0) {
+    sequence->low_bits = (uint64_t*)calloc(sequence->num_low_bit_words, sizeof(uint64_t));
+    assert(sequence->low_bits);
+  }
+  sequence->high_bits = (uint64_t*)calloc(sequence->num_high_bit_words, sizeof(uint64_t));
+  sequence->select_samples = (uint64_t*)malloc(sizeof(uint64_t) * sequence->num_select_samples);
+  assert(sequence->high_bits && sequence->select_samples);
+  kvec_t_uint64_t sparse_select_positions;
+  kv_init(sparse_select_positions.v);
+  uint64_t block_positions[ELIAS_FANO_SELECT_SAMPLE_RATE];
+  uint64_t low_bit_mask = (((uint64_t)1) << sequence->num_low_bits) - 1;
+  for (uint64_t i = 0; i < num_values; ++i) {
+    assert(i == 0 || values[i] >= values[i - 1]);
+    if (sequence->num_low_bits > 0) {
+      uint64_t bit_index = i * sequence->num_low_bits;
+      uint64_t low_bits = values[i] & low_bit_mask;
+      sequence->low_bits[bit_index >> 6] |= low_bits << (bit_index & 63);
+      if ((bit_index & 63) + sequence->num_low_bits > 64) {
+        sequence->low_bits[(bit_index >> 6) + 1] |= low_bits >> (64 - (bit_index & 63));
+      }
+    }
+    uint64_t position = (((uint64_t)values[i]) >> sequence->num_low_bits) + i;
+    sequence->high_bits[position >> 6] |= ((uint64_t)1) << (position & 63);
+    block_positions[i % ELIAS_FANO_SELECT_SAMPLE_RATE] = position;
+    if ((i + 1) % ELIAS_FANO_SELECT_SAMPLE_RATE == 0 || i + 1 == num_values) {
+      uint64_t num_block_positions = i % ELIAS_FANO_SELECT_SAMPLE_RATE + 1;
+      uint64_t sample_index = i / ELIAS_FANO_SELECT_SAMPLE_RATE;
+      if (position - block_positions[0] >= ELIAS_FANO_SPARSE_BLOCK_SPAN) {
+        sequence->select_samples[sample_index] = ELIAS_FANO_SPARSE_SAMPLE_FLAG | kv_size(sparse_select_positions.v);
+        for (uint64_t j = 0; j < num_block_positions; ++j) {
+          kv_push(uint64_t, sparse_select_positions.v, block_positions[j]);
+        }
+      } else {
+        sequence->select_samples[sample_index] = block_positions[0];
+      }
+    }
+  }
+  sequence->num_sparse_select_positions = kv_size(sparse_select_positions.v);
+  sequence->sparse_select_positions = sparse_select_positions.v.a;
+}
+
 void initialize_index(Index *index) {
   index->index_file = NULL;
   index->lookup_table = NULL;
+  index->lookup_table_encoding = INDEX_LOOKUP_TABLE_DENSE;
+  memset(&(index->succinct_lookup_table), 0, sizeof(EliasFanoSequence));
+  index->sparse_prefix_bits = 0;
+  index->sparse_directory = NULL;
+  index->num_distinct_seeds = 0;
+  index->sparse_suffixes = NULL;
+  index->sparse_occurrence_offsets = NULL;
   index->occurrence_table = NULL;
+  index->occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_LOCATION;
+  index->compact_occurrence_table = NULL;
+  index->compressed_occurrence_table_size = 0;
+  index->occurrence_block_offsets = NULL;
+  index->num_sequences = 0;
+  index->sequence_offsets = NULL;
+  index->max_bucket_size = 0;
+  index->keep_repeat_occurrences = 1;
+  index->num_repeat_buckets = 0;
+  index->repeat_hash_values = NULL;
+  index->repeat_lookup_table = NULL;
+  index->repeat_occurrence_table_size = 0;
+  index->repeat_occurrence_table = NULL;
+  index->prefault_mode = INDEX_PREFAULT_NONE;
+  initialize_memory_placement(&(index->memory_placement));
+  index->num_threads = 1;
+  index->direct_io = 0;
+  index->compress_index_file = 0;
+  index->construction_method = INDEX_CONSTRUCTION_BY_SORTING;
+  index->skip_ambiguous_seeds = 0;
+  index->embed_reference = 0;
+  index->canonical_seeds = 0;
+  index->minimizer_seeds = 0;
+  initialize_packed_reference(&(index->reference));
+  index->mapped_index = NULL;
+  index->mapped_index_size = 0;
+  index->placed_index_size = 0;
+  initialize_streamvbyte_tables();
 }
 
 void destroy_index(Index *index) {
+  if (index->mapped_index != NULL) {
+    if (index->placed_index_size > 0) {
+      free_placed_memory(index->mapped_index, index->placed_index_size);
+      index->placed_index_size = 0;
+    } else {
+      munmap(index->mapped_index, index->mapped_index_size);
+    }
+    index->mapped_index = NULL;
+    index->lookup_table = NULL;
+    memset(&(index->succinct_lookup_table), 0, sizeof(EliasFanoSequence));
+    index->sparse_directory = NULL;
+    index->sparse_suffixes = NULL;
+    index->sparse_occurrence_offsets = NULL;
+    index->occurrence_table = NULL;
+    index->compact_occurrence_table = NULL;
+    index->occurrence_block_offsets = NULL;
+    index->sequence_offsets = NULL;
+    index->repeat_hash_values = NULL;
+    index->repeat_lookup_table = NULL;
+    index->repeat_occurrence_table = NULL;
+    destroy_packed_reference(&(index->reference));
+    return;
+  }
+  destroy_packed_reference(&(index->reference));
   if (index->lookup_table != NULL) {
     free(index->lookup_table);
     index->lookup_table = NULL;
   }
+  destroy_elias_fano_sequence(&(index->succinct_lookup_table));
+  if (index->sparse_directory != NULL) {
+    free(index->sparse_directory);
+    index->sparse_directory = NULL;
+  }
+  if (index->sparse_suffixes != NULL) {
+    free(index->sparse_suffixes);
+    index->sparse_suffixes = NULL;
+  }
+  if (index->sparse_occurrence_offsets != NULL) {
+    free(index->sparse_occurrence_offsets);
+    index->sparse_occurrence_offsets = NULL;
+  }
   if (index->occurrence_table != NULL) {
     free(index->occurrence_table);
     index->occurrence_table = NULL;
   }
+  if (index->compact_occurrence_table != NULL) {
+    free(index->compact_occurrence_table);
+    index->compact_occurrence_table = NULL;
+  }
+  if (index->occurrence_block_offsets != NULL) {
+    free(index->occurrence_block_offsets);
+    index->occurrence_block_offsets = NULL;
+  }
+  if (index->sequence_offsets != NULL) {
+    free(index->sequence_offsets);
+    index->sequence_offsets = NULL;
+  }
+  if (index->repeat_hash_values != NULL) {
+    free(index->repeat_hash_values);
+    index->repeat_hash_values = NULL;
+  }
+  if (index->repeat_lookup_table != NULL) {
+    free(index->repeat_lookup_table);
+    index->repeat_lookup_table = NULL;
+  }
+  if (index->repeat_occurrence_table != NULL) {
+    free(index->repeat_occurrence_table);
+    index->repeat_occurrence_table = NULL;
+  }
+}
+
+size_t get_occurrence_table_size_in_bytes(const Index *index) {
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32) {
+    return sizeof(uint32_t) * index->occurrence_table_size;
+  } else if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_40) {
+    // 3 bytes of padding so that the last entry can be read with one 8-byte load
+    return 5 * index->occurrence_table_size + 3;
+  } else if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+    return index->compressed_occurrence_table_size;
+  }
+  return sizeof(uint64_t) * index->occurrence_table_size;
+}
+
+static inline size_t get_sparse_suffix_size(const Index *index) {
+  return get_sparse_suffix_bits(index) > 32 ? sizeof(uint64_t) : sizeof(uint32_t);
+}
+
+// Chooses about one directory entry per distinct k-mer.
+static inline int choose_sparse_prefix_bits(int kmer_size, size_t num_distinct_seeds) {
+  int prefix_bits = INDEX_MIN_SPARSE_PREFIX_BITS;
+  while (prefix_bits < INDEX_MAX_SPARSE_PREFIX_BITS && (((size_t)1) << (prefix_bits + 1)) <= num_distinct_seeds) {
+    ++prefix_bits;
+  }
+  return prefix_bits < 2 * kmer_size ? prefix_bits : 2 * kmer_size;
+}
+
+size_t get_lookup_table_size_in_bytes(const Index *index) {
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_ELIAS_FANO) {
+    return get_elias_fano_sequence_size_in_bytes(&(index->succinct_lookup_table));
+  } else if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    return sizeof(uint64_t) * ((((size_t)1) << index->sparse_prefix_bits) + 1) + get_sparse_suffix_size(index) * index->num_distinct_seeds + sizeof(uint64_t) * (index->num_distinct_seeds + 1);
+  }
+  return sizeof(uint32_t) * ((((size_t)1) << (2 * index->kmer_size)) + 1);
+}
+
+// Estimates the memory of the index that construct_index would build with the
+// current parameters, plus the reference as FEM map loads it.
+void estimate_index_memory(const SequenceBatch *sequence_batch, const Index *index, IndexMemoryEstimate *estimate) {
+  Index estimated_index = *index;
+  estimated_index.num_sequences = sequence_batch->num_loaded_sequences;
+  estimated_index.occurrence_table_size = 0;
+  estimate->reference_size = 0;
+  estimate->embedded_reference_size = 0;
+  size_t packed_reference_size = sizeof(uint64_t) * (get_num_packed_base_words(sequence_batch->num_bases) + get_num_ambiguous_base_words(sequence_batch->num_bases) + 1);
+  for (uint32_t sequence_index = 0; sequence_index < sequence_batch->num_loaded_sequences; ++sequence_index) {
+    uint32_t sequence_length = get_sequence_length_from_sequence_batch_at(sequence_batch, sequence_index);
+    if (index->minimizer_seeds) {
+      // Random sequences have about 2 / (w + 1) minimizers per seed.
+      if (sequence_length >= (uint32_t)(index->step_size + index->kmer_size - 1)) {
+        estimated_index.occurrence_table_size += 2 * (size_t)(sequence_length - index->kmer_size + 1) / (index->step_size + 1);
+      }
+    } else if (sequence_length >= (uint32_t)index->kmer_size) {
+      estimated_index.occurrence_table_size += (sequence_length - index->kmer_size) / index->step_size + 1;
+    }
+    // FEM map keeps only the names and lengths of the sequences, and their
+    // bases stay packed.
+    estimate->reference_size += get_sequence_name_length_from_sequence_batch_at(sequence_batch, sequence_index) + 1 + sizeof(kseq_t);
+    packed_reference_size += get_sequence_name_length_from_sequence_batch_at(sequence_batch, sequence_index) + 1 + sizeof(uint64_t);
+  }
+  if (estimated_index.occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+    // An upper bound, as the size depends on how far apart the seeds of a bucket are.
+    estimated_index.compressed_occurrence_table_size = (4 + 0.25) * estimated_index.occurrence_table_size + INDEX_OCCURRENCE_BLOCK_PADDING;
+    estimated_index.compressed_occurrence_table_size += sizeof(uint64_t) * ((estimated_index.occurrence_table_size + INDEX_OCCURRENCE_BLOCK_SIZE - 1) / INDEX_OCCURRENCE_BLOCK_SIZE + 1); // block offsets
+    estimate->sequence_offsets_size = sizeof(uint64_t) * (estimated_index.num_sequences + 1);
+  } else if (estimated_index.occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION) {
+    uint64_t reference_length = sequence_batch->num_bases;
+    estimated_index.occurrence_table_encoding = reference_length <= ((uint64_t)1) << 32 ? INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32 : INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_40;
+    estimate->sequence_offsets_size = sizeof(uint64_t) * (estimated_index.num_sequences + 1);
+  } else {
+    estimate->sequence_offsets_size = 0;
+  }
+  estimate->num_seeds = estimated_index.occurrence_table_size;
+  if (estimated_index.lookup_table_encoding == INDEX_LOOKUP_TABLE_ELIAS_FANO) {
+    // Sparse select positions depend on the distribution of the seeds and are left out.
+    initialize_elias_fano_sequence((((uint64_t)1) << (2 * index->kmer_size)) + 1, estimated_index.occurrence_table_size, &(estimated_index.succinct_lookup_table));
+  }
+  if (estimated_index.lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    // An upper bound, as if every seed were a distinct k-mer.
+    estimated_index.num_distinct_seeds = estimated_index.occurrence_table_size;
+    estimated_index.sparse_prefix_bits = choose_sparse_prefix_bits(index->kmer_size, estimated_index.num_distinct_seeds);
+  }
+  estimate->lookup_table_size = get_lookup_table_size_in_bytes(&estimated_index);
+  estimate->occurrence_table_size = get_occurrence_table_size_in_bytes(&estimated_index);
+  // Without an embedded reference, FEM map packs the one it parses.
+  if (index->embed_reference) {
+    estimate->embedded_reference_size = packed_reference_size;
+  } else {
+    estimate->reference_size += packed_reference_size;
+  }
+  estimate->total_size = estimate->lookup_table_size + estimate->occurrence_table_size + estimate->sequence_offsets_size + estimate->embedded_reference_size + estimate->reference_size;
+}
+
+void print_index_memory_estimate(const IndexMemoryEstimate *estimate) {
+  fprintf(stderr, "Number of seeds: %ld\n", estimate->num_seeds);
+  fprintf(stderr, "Lookup table: %.2f MB\n", estimate->lookup_table_size / 1048576.0);
+  fprintf(stderr, "Occurrence table: %.2f MB\n", estimate->occurrence_table_size / 1048576.0);
+  if (estimate->sequence_offsets_size > 0) {
+    fprintf(stderr, "Sequence offsets: %.2f MB\n", estimate->sequence_offsets_size / 1048576.0);
+  }
+  if (estimate->embedded_reference_size > 0) {
+    fprintf(stderr, "Embedded reference: %.2f MB\n", estimate->embedded_reference_size / 1048576.0);
+  }
+  fprintf(stderr, "Reference: %.2f MB\n", estimate->reference_size / 1048576.0);
+  fprintf(stderr, "Total: %.2f MB\n", estimate->total_size / 1048576.0);
+}
+
+#define INDEX_STATISTICS_NUM_BINS 33 // bin b holds the buckets of 2^b to 2^(b+1) - 1 locations
+
+typedef struct {
+  uint64_t hash_value;
+  uint32_t size;
+} IndexBucket;
+
+typedef struct {
+  uint64_t num_buckets[INDEX_STATISTICS_NUM_BINS];
+  uint64_t num_occurrences[INDEX_STATISTICS_NUM_BINS];
+  uint64_t num_nonempty_buckets;
+  uint64_t num_total_occurrences;
+  double sum_of_squared_sizes;
+  IndexBucket *largest_buckets; // sorted by decreasing size
+  int num_largest_buckets;
+  int max_num_largest_buckets;
+} IndexStatistics;
+
+static void add_bucket_to_index_statistics(uint64_t hash_value, uint32_t bucket_size, IndexStatistics *statistics) {
+  if (bucket_size == 0) {
+    return;
+  }
+  int bin = 31 - __builtin_clz(bucket_size);
+  ++statistics->num_buckets[bin];
+  statistics->num_occurrences[bin] += bucket_size;
+  ++statistics->num_nonempty_buckets;
+  statistics->num_total_occurrences += bucket_size;
+  statistics->sum_of_squared_sizes += (double)bucket_size * bucket_size;
+  // Few buckets beat the smallest of the largest ones, so an insertion into the sorted array is enough.
+  int position = statistics->num_largest_buckets;
+  if (position == statistics->max_num_largest_buckets) {
+    if (position == 0 || statistics->largest_buckets[position - 1].size >= bucket_size) {
+      return;
+    }
+    --position;
+  } else {
+    ++statistics->num_largest_buckets;
+  }
+  for (; position > 0 && statistics->largest_buckets[position - 1].size < bucket_size; --position) {
+    statistics->largest_buckets[position] = statistics->largest_buckets[position - 1];
+  }
+  statistics->largest_buckets[position].hash_value = hash_value;
+  statistics->largest_buckets[position].size = bucket_size;
+}
+
+// Visits every bucket of the lookup table and of the repeat table.
+static void collect_index_statistics(const Index *index, IndexStatistics *statistics) {
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    int suffix_bits = get_sparse_suffix_bits(index);
+    size_t num_prefixes = ((size_t)1) << index->sparse_prefix_bits;
+    for (size_t prefix = 0; prefix < num_prefixes; ++prefix) {
+      for (size_t seed_index = index->sparse_directory[prefix]; seed_index < index->sparse_directory[prefix + 1]; ++seed_index) {
+        uint64_t suffix = suffix_bits > 32 ? ((const uint64_t*)index->sparse_suffixes)[seed_index] : ((const uint32_t*)index->sparse_suffixes)[seed_index];
+        uint64_t hash_value = suffix_bits >= 64 ? suffix : (((uint64_t)prefix) << suffix_bits) | suffix;
+        add_bucket_to_index_statistics(hash_value, index->sparse_occurrence_offsets[seed_index + 1] - index->sparse_occurrence_offsets[seed_index], statistics);
+      }
+    }
+  } else {
+    size_t num_hash_values = ((size_t)1) << (2 * index->kmer_size);
+    for (size_t hash_value = 0; hash_value < num_hash_values; ++hash_value) {
+      uint64_t occurrence_start, occurrence_end;
+      get_seed_occurrence_range(index, hash_value, &occurrence_start, &occurrence_end);
+      add_bucket_to_index_statistics(hash_value, occurrence_end - occurrence_start, statistics);
+    }
+  }
+  for (uint32_t repeat_bucket = 0; repeat_bucket < index->num_repeat_buckets; ++repeat_bucket) {
+    add_bucket_to_index_statistics(index->repeat_hash_values[repeat_bucket], index->repeat_lookup_table[repeat_bucket + 1] - index->repeat_lookup_table[repeat_bucket], statistics);
+  }
+}
+
+// Prints the bucket size histogram, the largest buckets and the size of each
+// component of a loaded index, and the expected number of locations that the
+// seeds of a read of the given length bring to verification.
+void print_index_statistics(const Index *index, int num_largest_buckets, int read_length, int error_threshold, int num_additional_qgrams) {
+  double real_start_time = get_real_time();
+  IndexStatistics statistics;
+  memset(&statistics, 0, sizeof(IndexStatistics));
+  statistics.max_num_largest_buckets = num_largest_buckets;
+  statistics.largest_buckets = (IndexBucket*)malloc(sizeof(IndexBucket) * (num_largest_buckets > 0 ? num_largest_buckets : 1));
+  assert(statistics.largest_buckets);
+  collect_index_statistics(index, &statistics);
+  double num_hash_values = ldexp(1.0, 2 * index->kmer_size);
+  fprintf(stderr, "Collected index statistics in %fs.\n", get_real_time() - real_start_time);
+
+  printf("Window size (k): %d\n", index->kmer_size);
+  printf("%s: %d\n", index->minimizer_seeds ? "Minimizer window (w)" : "Step size", index->step_size);
+  printf("Seeds: %s%s%s\n", index->canonical_seeds ? "canonical" : "forward strand", index->skip_ambiguous_seeds ? ", ambiguous seeds skipped" : "", index->max_bucket_size > 0 ? (index->keep_repeat_occurrences ? ", repeats in a separate table" : ", repeat locations dropped") : "");
+  printf("Indexed locations: %"PRIu64"\n", statistics.num_total_occurrences);
+  printf("Non-empty buckets: %"PRIu64" of %.0f (%.2f%% empty)\n", statistics.num_nonempty_buckets, num_hash_values, 100.0 * (1.0 - statistics.num_nonempty_buckets / num_hash_values));
+  if (index->max_bucket_size > 0) {
+    printf("Repeat buckets (more than %u locations): %u with %zu locations\n", index->max_bucket_size, index->num_repeat_buckets, index->repeat_occurrence_table_size);
+  }
+
+  printf("\nBucket size histogram:\n");
+  printf("%-23s %12s %9s %14s %9s %12s\n", "size", "buckets", "%", "locations", "%", "cumulative %");
+  uint64_t num_cumulative_occurrences = 0;
+  for (int bin = 0; bin < INDEX_STATISTICS_NUM_BINS; ++bin) {
+    if (statistics.num_buckets[bin] == 0) {
+      continue;
+    }
+    num_cumulative_occurrences += statistics.num_occurrences[bin];
+    char size_range[32];
+    if (bin == 0) {
+      snprintf(size_range, sizeof(size_range), "1");
+    } else {
+      snprintf(size_range, sizeof(size_range), "%"PRIu64"-%"PRIu64, ((uint64_t)1) << bin, (((uint64_t)1) << (bin + 1)) - 1);
+    }
+    printf("%-23s %12"PRIu64" %9.4f %14"PRIu64" %9.4f %12.4f\n", size_range, statistics.num_buckets[bin], 100.0 * statistics.num_buckets[bin] / statistics.num_nonempty_buckets, statistics.num_occurrences[bin], 100.0 * statistics.num_occurrences[bin] / statistics.num_total_occurrences, 100.0 * num_cumulative_occurrences / statistics.num_total_occurrences);
+  }
+
+  printf("\nLargest buckets:\n");
+  char kmer[INDEX_MAX_SPARSE_KMER_SIZE + 1];
+  for (int i = 0; i < statistics.num_largest_buckets; ++i) {
+    uint64_t hash_value = statistics.largest_buckets[i].hash_value;
+    for (int base_index = 0; base_index < index->kmer_size; ++base_index) {
+      kmer[base_index] = uint8_to_char((hash_value >> (2 * (index->kmer_size - 1 - base_index))) & 3);
+    }
+    kmer[index->kmer_size] = '\0';
+    printf("%s %u%s\n", kmer, statistics.largest_buckets[i].size, is_repeat_seed_frequency(index, statistics.largest_buckets[i].size) ? " (repeat)" : "");
+  }
+
+  size_t repeat_table_size = sizeof(uint32_t) * (2 * (size_t)index->num_repeat_buckets + (index->num_repeat_buckets > 0 ? 1 : 0)) + (index->repeat_occurrence_table != NULL ? sizeof(uint64_t) * index->repeat_occurrence_table_size : 0);
+  size_t sequence_offsets_size = index->occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION ? sizeof(uint64_t) * (index->num_sequences + 1) : 0;
+  const PackedReference *reference = &(index->reference);
+  size_t embedded_reference_size = reference->num_sequences > 0 ? kv_size(reference->names.v) + sizeof(uint64_t) * (reference->num_sequences + 1 + get_num_packed_base_words(reference->num_bases) + get_num_ambiguous_base_words(reference->num_bases)) : 0;
+  printf("\nMemory:\n");
+  printf("Lookup table: %.2f MB\n", get_lookup_table_size_in_bytes(index) / 1048576.0);
+  printf("Occurrence table: %.2f MB\n", get_occurrence_table_size_in_bytes(index) / 1048576.0);
+  printf("Repeat table: %.2f MB\n", repeat_table_size / 1048576.0);
+  printf("Sequence offsets: %.2f MB\n", sequence_offsets_size / 1048576.0);
+  printf("Embedded reference: %.2f MB\n", embedded_reference_size / 1048576.0);
+  printf("Total: %.2f MB\n", (get_lookup_table_size_in_bytes(index) + get_occurrence_table_size_in_bytes(index) + repeat_table_size + sequence_offsets_size + embedded_reference_size) / 1048576.0);
+
+  // A seed taken from the reference falls in a bucket of size f with
+  // probability f / (total locations), so its expected bucket size is the sum
+  // of f^2 over the total. Seed selection prefers rare seeds, which makes the
+  // per-read figure an upper bound.
+  int num_seeds_per_group = error_threshold + 1 + num_additional_qgrams;
+  int num_seed_groups = index->minimizer_seeds ? 1 : index->step_size;
+  double expected_occurrences_per_seed = statistics.num_total_occurrences > 0 ? statistics.sum_of_squared_sizes / statistics.num_total_occurrences : 0;
+  printf("\nExpected locations per seed:\n");
+  printf("Random k-mer: %.4f\n", statistics.num_total_occurrences / num_hash_values);
+  printf("k-mer drawn from the reference: %.4f\n", expected_occurrences_per_seed);
+  printf("Reads of length %d with %d errors and %d additional q-grams: %d seed group(s) of %d seeds, at most %.2f locations per strand\n", read_length, error_threshold, num_additional_qgrams, num_seed_groups, num_seeds_per_group, num_seed_groups * num_seeds_per_group * expected_occurrences_per_seed);
+  free(statistics.largest_buckets);
+}
+
+static inline uint64_t get_global_offset_in_compact_occurrence_table(const Index *index, size_t occurrence_index) {
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32) {
+    return ((const uint32_t*)index->compact_occurrence_table)[occurrence_index];
+  }
+  uint64_t global_offset;
+  memcpy(&global_offset, index->compact_occurrence_table + 5 * occurrence_index, sizeof(uint64_t));
+  return global_offset & ((((uint64_t)1) << 40) - 1);
+}
+
+// Returns the sequence that contains the global offset, searching from the sequence given as a hint.
+static inline uint32_t find_sequence_by_global_offset(const Index *index, uint64_t global_offset, uint32_t sequence_index) {
+  uint32_t high = index->num_sequences;
+  while (sequence_index + 1 < high) {
+    uint32_t middle = (sequence_index + high) / 2;
+    if (index->sequence_offsets[middle] <= global_offset) {
+      sequence_index = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return sequence_index;
+}
+
+static inline void decode_streamvbyte_group(uint8_t control, const uint8_t *data, uint32_t *values) {
+#ifdef __SSSE3__
+  __m128i shuffle_mask = _mm_loadu_si128((const __m128i*)streamvbyte_shuffle_masks[control]);
+  _mm_storeu_si128((__m128i*)values, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), shuffle_mask));
+#else
+  for (int lane = 0; lane < 4; ++lane) {
+    int num_bytes = ((control >> (2 * lane)) & 3) + 1;
+    values[lane] = 0;
+    memcpy(values + lane, data, num_bytes); // little-endian
+    data += num_bytes;
+  }
+#endif
+}
+
+// Decodes the deltas of the groups of four entries that cover [occurrence_start, occurrence_end)
+// of the delta-coded occurrence table, starting with the group that contains occurrence_start.
+static void decode_occurrence_deltas(const Index *index, uint64_t occurrence_start, uint64_t occurrence_end, uint32_t *deltas) {
+  uint64_t occurrence_index = occurrence_start & ~((uint64_t)3);
+  while (occurrence_index < occurrence_end) {
+    uint64_t block_index = occurrence_index / INDEX_OCCURRENCE_BLOCK_SIZE;
+    uint64_t block_start = block_index * INDEX_OCCURRENCE_BLOCK_SIZE;
+    uint64_t block_end = block_start + INDEX_OCCURRENCE_BLOCK_SIZE < index->occurrence_table_size ? block_start + INDEX_OCCURRENCE_BLOCK_SIZE : index->occurrence_table_size;
+    uint64_t num_groups = (block_end - block_start + 3) / 4;
+    const uint8_t *controls = index->compact_occurrence_table + index->occurrence_block_offsets[block_index];
+    const uint8_t *data = controls + num_groups;
+    uint64_t group_index = (occurrence_index - block_start) / 4;
+    for (uint64_t i = 0; i < group_index; ++i) {
+      data += streamvbyte_lengths[controls[i]];
+    }
+    uint64_t group_end = occurrence_end < block_end ? (occurrence_end - block_start + 3) / 4 : num_groups;
+    for (; group_index < group_end; ++group_index) {
+      decode_streamvbyte_group(controls[group_index], data, deltas);
+      data += streamvbyte_lengths[controls[group_index]];
+      deltas += 4;
+    }
+    occurrence_index = block_start + 4 * group_end;
+  }
+}
+
+const uint64_t *decode_seed_occurrences(const Index *index, uint64_t hash_value, kvec_t_uint64_t *occurrence_buffer) {
+  uint64_t occurrence_start, occurrence_end;
+  get_seed_occurrence_range(index, hash_value, &occurrence_start, &occurrence_end);
+  uint32_t num_occurrences = occurrence_end - occurrence_start;
+  // Delta-coded buckets are decoded into the space behind the locations
+  // first, which also holds up to three entries before and after the bucket.
+  size_t buffer_size = num_occurrences;
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+    buffer_size += (num_occurrences + 8) / 2 + 1;
+  }
+  if (kv_max(occurrence_buffer->v) < buffer_size) {
+    kv_resize(uint64_t, occurrence_buffer->v, buffer_size);
+  }
+  kv_size(occurrence_buffer->v) = num_occurrences;
+  uint32_t *deltas = NULL;
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS && num_occurrences > 0) {
+    deltas = (uint32_t*)(occurrence_buffer->v.a + num_occurrences);
+    decode_occurrence_deltas(index, occurrence_start, occurrence_end, deltas);
+    deltas += occurrence_start & 3;
+  }
+  // Occurrences are sorted, so the sequence index never decreases within a bucket.
+  uint32_t sequence_index = 0;
+  uint64_t sequence_end = 0;
+  uint64_t global_offset = 0;
+  for (uint32_t i = 0; i < num_occurrences; ++i) {
+    if (deltas != NULL) {
+      global_offset += deltas[i];
+    } else {
+      global_offset = get_global_offset_in_compact_occurrence_table(index, occurrence_start + i);
+    }
+    if (global_offset >= sequence_end) {
+      sequence_index = find_sequence_by_global_offset(index, global_offset, sequence_index);
+      sequence_end = index->sequence_offsets[sequence_index + 1];
+    }
+    kv_A(occurrence_buffer->v, i) = ((uint64_t)sequence_index) << 32 | (global_offset - index->sequence_offsets[sequence_index]);
+  }
+  return occurrence_buffer->v.a;
+}
+
+// Removes the locations of seeds that overlap an ambiguous base from the
+// dense lookup table and the occurrence table, compacting both in place.
+static void remove_ambiguous_seeds(const SequenceBatch *sequence_batch, Index *index) {
+  double real_start_time = get_real_time();
+  size_t lookup_table_size = (((size_t)1) << (2 * index->kmer_size)) + 1;
+  size_t num_occurrences = 0;
+  uint32_t bucket_start = index->lookup_table[0];
+  for (size_t hash_value = 0; hash_value + 1 < lookup_table_size; ++hash_value) {
+    uint32_t bucket_end = index->lookup_table[hash_value + 1];
+    index->lookup_table[hash_value] = num_occurrences;
+    for (uint32_t i = bucket_start; i < bucket_end; ++i) {
+      uint64_t location = index->occurrence_table[i];
+      if (!seed_has_ambiguous_base((uint32_t)location, index->kmer_size, get_sequence_from_sequence_batch_at(sequence_batch, (location & ~INDEX_OCCURRENCE_REVERSE_STRAND) >> 32))) {
+        index->occurrence_table[num_occurrences++] = location;
+      }
+    }
+    bucket_start = bucket_end;
+  }
+  index->lookup_table[lookup_table_size - 1] = num_occurrences;
+  fprintf(stderr, "Removed %ld seeds with ambiguous bases in %fs.\n", index->occurrence_table_size - num_occurrences, get_real_time() - real_start_time);
+  index->occurrence_table_size = num_occurrences;
+  index->occurrence_table = (uint64_t*)realloc(index->occurrence_table, sizeof(uint64_t) * (num_occurrences > 0 ? num_occurrences : 1));
+  assert(index->occurrence_table);
+}
+
+// Moves the buckets larger than max_bucket_size out of the dense lookup table
+// and the occurrence table into the repeat table, compacting both in place.
+static void extract_repeat_buckets(Index *index) {
+  double real_start_time = get_real_time();
+  kvec_t_uint32_t repeat_hash_values;
+  kvec_t_uint32_t repeat_lookup_table;
+  kvec_t_uint64_t repeat_occurrence_table;
+  kv_init(repeat_hash_values.v);
+  kv_init(repeat_lookup_table.v);
+  kv_init(repeat_occurrence_table.v);
+  kv_push(uint32_t, repeat_lookup_table.v, 0);
+  size_t lookup_table_size = (((size_t)1) << (2 * index->kmer_size)) + 1;
+  size_t num_occurrences = 0;
+  size_t num_repeat_occurrences = 0;
+  uint32_t bucket_start = index->lookup_table[0];
+  for (size_t hash_value = 0; hash_value + 1 < lookup_table_size; ++hash_value) {
+    uint32_t bucket_end = index->lookup_table[hash_value + 1];
+    index->lookup_table[hash_value] = num_occurrences;
+    if (bucket_end - bucket_start > index->max_bucket_size) {
+      kv_push(uint32_t, repeat_hash_values.v, hash_value);
+      num_repeat_occurrences += bucket_end - bucket_start;
+      kv_push(uint32_t, repeat_lookup_table.v, num_repeat_occurrences);
+      if (index->keep_repeat_occurrences) {
+        for (uint32_t i = bucket_start; i < bucket_end; ++i) {
+          kv_push(uint64_t, repeat_occurrence_table.v, index->occurrence_table[i]);
+        }
+      }
+    } else {
+      memmove(index->occurrence_table + num_occurrences, index->occurrence_table + bucket_start, sizeof(uint64_t) * (bucket_end - bucket_start));
+      num_occurrences += bucket_end - bucket_start;
+    }
+    bucket_start = bucket_end;
+  }
+  index->lookup_table[lookup_table_size - 1] = num_occurrences;
+  index->occurrence_table_size = num_occurrences;
+  index->occurrence_table = (uint64_t*)realloc(index->occurrence_table, sizeof(uint64_t) * (num_occurrences > 0 ? num_occurrences : 1));
+  assert(index->occurrence_table);
+  index->num_repeat_buckets = kv_size(repeat_hash_values.v);
+  index->repeat_hash_values = repeat_hash_values.v.a;
+  index->repeat_lookup_table = repeat_lookup_table.v.a;
+  index->repeat_occurrence_table_size = num_repeat_occurrences;
+  index->repeat_occurrence_table = repeat_occurrence_table.v.a;
+  fprintf(stderr, "Moved %d buckets with %ld seeds to the repeat table in %fs.\n", index->num_repeat_buckets, num_repeat_occurrences, get_real_time() - real_start_time);
+}
+
+static void compute_sequence_offsets(const SequenceBatch *sequence_batch, Index *index) {
+  index->num_sequences = sequence_batch->num_loaded_sequences;
+  index->sequence_offsets = (uint64_t*)malloc(sizeof(uint64_t) * (index->num_sequences + 1));
+  assert(index->sequence_offsets);
+  index->sequence_offsets[0] = 0;
+  for (uint32_t sequence_index = 0; sequence_index < index->num_sequences; ++sequence_index) {
+    index->sequence_offsets[sequence_index + 1] = index->sequence_offsets[sequence_index] + get_sequence_length_from_sequence_batch_at(sequence_batch, sequence_index);
+  }
+}
+
+// Replaces the occurrence table by global offsets into the concatenated
+// reference, with 32-bit entries when the reference is short enough.
+static void compact_occurrence_table(const SequenceBatch *sequence_batch, Index *index) {
+  compute_sequence_offsets(sequence_batch, index);
+  uint64_t reference_length = index->sequence_offsets[index->num_sequences];
+  if (reference_length > ((uint64_t)1) << 40) {
+    fprintf(stderr, "The reference is too long for a compact occurrence table.\n");
+    exit(EXIT_FAILURE);
+  }
+  index->occurrence_table_encoding = reference_length <= ((uint64_t)1) << 32 ? INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32 : INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_40;
+  index->compact_occurrence_table = (uint8_t*)calloc(get_occurrence_table_size_in_bytes(index), 1);
+  assert(index->compact_occurrence_table);
+  for (size_t i = 0; i < index->occurrence_table_size; ++i) {
+    uint64_t location = index->occurrence_table[i];
+    uint64_t global_offset = index->sequence_offsets[location >> 32] + (uint32_t)location;
+    if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32) {
+      ((uint32_t*)index->compact_occurrence_table)[i] = global_offset;
+    } else {
+      memcpy(index->compact_occurrence_table + 5 * i, &global_offset, 5); // little-endian
+    }
+  }
+  free(index->occurrence_table);
+  index->occurrence_table = NULL;
+  fprintf(stderr, "Compacted occurrence table to %ld bytes.\n", get_occurrence_table_size_in_bytes(index));
+}
+
+static inline uint8_t get_streamvbyte_code(uint32_t value) {
+  return value < (1 << 8) ? 0 : value < (1 << 16) ? 1 : value < (1 << 24) ? 2 : 3;
+}
+
+// Replaces the occurrence table by StreamVByte blocks of global offset deltas.
+// Needs the dense lookup table to find where buckets start.
+static void compress_occurrence_table(const SequenceBatch *sequence_batch, Index *index) {
+  double real_start_time = get_real_time();
+  compute_sequence_offsets(sequence_batch, index);
+  if (index->sequence_offsets[index->num_sequences] > ((uint64_t)1) << 32) {
+    fprintf(stderr, "The reference is too long for a delta-coded occurrence table.\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t num_occurrences = index->occurrence_table_size;
+  size_t num_blocks = (num_occurrences + INDEX_OCCURRENCE_BLOCK_SIZE - 1) / INDEX_OCCURRENCE_BLOCK_SIZE;
+  // Entries are padded to whole groups of four with zero deltas.
+  uint32_t *deltas = (uint32_t*)calloc(num_occurrences + 4, sizeof(uint32_t));
+  assert(deltas);
+  uint32_t hash_value = 0;
+  uint64_t previous_global_offset = 0;
+  for (size_t i = 0; i < num_occurrences; ++i) {
+    while (index->lookup_table[hash_value + 1] <= i) {
+      ++hash_value;
+    }
+    uint64_t location = index->occurrence_table[i];
+    uint64_t global_offset = index->sequence_offsets[location >> 32] + (uint32_t)location;
+    deltas[i] = index->lookup_table[hash_value] == i ? global_offset : global_offset - previous_global_offset;
+    previous_global_offset = global_offset;
+  }
+  index->occurrence_block_offsets = (uint64_t*)malloc(sizeof(uint64_t) * (num_blocks + 1));
+  assert(index->occurrence_block_offsets);
+  size_t compressed_size = 0;
+  for (size_t block_index = 0; block_index < num_blocks; ++block_index) {
+    index->occurrence_block_offsets[block_index] = compressed_size;
+    size_t block_start = block_index * INDEX_OCCURRENCE_BLOCK_SIZE;
+    size_t block_end = block_start + INDEX_OCCURRENCE_BLOCK_SIZE < num_occurrences ? block_start + INDEX_OCCURRENCE_BLOCK_SIZE : num_occurrences;
+    size_t num_groups = (block_end - block_start + 3) / 4;
+    compressed_size += num_groups;
+    for (size_t i = block_start; i < block_start + 4 * num_groups; ++i) {
+      compressed_size += get_streamvbyte_code(deltas[i]) + 1;
+    }
+  }
+  index->occurrence_block_offsets[num_blocks] = compressed_size;
+  index->occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS;
+  index->compressed_occurrence_table_size = compressed_size + INDEX_OCCURRENCE_BLOCK_PADDING;
+  index->compact_occurrence_table = (uint8_t*)calloc(index->compressed_occurrence_table_size, 1);
+  assert(index->compact_occurrence_table);
+  for (size_t block_index = 0; block_index < num_blocks; ++block_index) {
+    size_t block_start = block_index * INDEX_OCCURRENCE_BLOCK_SIZE;
+    size_t block_end = block_start + INDEX_OCCURRENCE_BLOCK_SIZE < num_occurrences ? block_start + INDEX_OCCURRENCE_BLOCK_SIZE : num_occurrences;
+    size_t num_groups = (block_end - block_start + 3) / 4;
+    uint8_t *controls = index->compact_occurrence_table + index->occurrence_block_offsets[block_index];
+    uint8_t *data = controls + num_groups;
+    for (size_t group_index = 0; group_index < num_groups; ++group_index) {
+      for (int lane = 0; lane < 4; ++lane) {
+        uint32_t delta = deltas[block_start + 4 * group_index + lane];
+        uint8_t code = get_streamvbyte_code(delta);
+        controls[group_index] |= code << (2 * lane);
+        memcpy(data, &delta, code + 1); // little-endian
+        data += code + 1;
+      }
+    }
+  }
+  free(deltas);
+  free(index->occurrence_table);
+  index->occurrence_table = NULL;
+  fprintf(stderr, "Compressed occurrence table to %ld bytes in %fs.\n", get_occurrence_table_size_in_bytes(index), get_real_time() - real_start_time);
+}
+
+// Returns the location of a seed and, in a canonical index, replaces its hash
+// value with the canonical one and marks the location if they differ.
+static inline uint64_t get_indexed_seed_location(const Index *index, uint32_t sequence_index, uint32_t sequence_position, uint64_t *hash_value) {
+  uint64_t location = ((uint64_t)sequence_index) << 32 | sequence_position;
+  if (index->canonical_seeds) {
+    uint64_t canonical_hash_value = get_canonical_seed(*hash_value, index->kmer_size);
+    if (canonical_hash_value != *hash_value) {
+      *hash_value = canonical_hash_value;
+      location |= INDEX_OCCURRENCE_REVERSE_STRAND;
+    }
+  }
+  return location;
+}
+
+// Appends the positions of the (w,k)-minimizers of a sequence, i.e. the
+// leftmost seed of smallest order in each window of step_size consecutive
+// seeds, each position once. Ambiguous bases are read as A, as when the seeds
+// are hashed, and a sequence shorter than one window has no minimizers. The
+// window minima are kept in a deque of increasing orders.
+static void collect_minimizer_positions(const Index *index, const char *sequence, uint32_t sequence_length, kvec_t_uint32_t *minimizer_positions) {
+  int window_size = index->step_size;
+  int kmer_size = index->kmer_size;
+  uint64_t mask = get_seed_mask(kmer_size);
+  uint64_t hash_value = 0;
+  uint32_t deque_positions[window_size];
+  uint64_t deque_orders[window_size];
+  int deque_front = 0;
+  int deque_size = 0;
+  int64_t last_minimizer_position = -1;
+  for (uint32_t position = 0; position < sequence_length; ++position) {
+    uint8_t current_base = char_to_uint8(sequence[position]);
+    hash_value = ((hash_value << 2) | (current_base < 4 ? current_base : 0)) & mask;
+    if (position + 1 < (uint32_t)kmer_size) {
+      continue;
+    }
+    uint32_t seed_position = position + 1 - kmer_size;
+    uint64_t order = get_minimizer_order(index->canonical_seeds ? get_canonical_seed(hash_value, kmer_size) : hash_value, kmer_size);
+    if (deque_size > 0 && deque_positions[deque_front] + window_size <= seed_position) {
+      deque_front = (deque_front + 1) % window_size;
+      --deque_size;
+    }
+    // Equal orders stay, so that the leftmost one is the minimizer.
+    while (deque_size > 0 && deque_orders[(deque_front + deque_size - 1) % window_size] > order) {
+      --deque_size;
+    }
+    deque_positions[(deque_front + deque_size) % window_size] = seed_position;
+    deque_orders[(deque_front + deque_size) % window_size] = order;
+    ++deque_size;
+    if (seed_position + 1 >= (uint32_t)window_size && deque_positions[deque_front] != last_minimizer_position) {
+      last_minimizer_position = deque_positions[deque_front];
+      kv_push(uint32_t, minimizer_positions->v, deque_positions[deque_front]);
+    }
+  }
+}
+
+// Returns the number of seeds sampled from a sequence. The minimizer positions
+// of a minimizer-sampled index must have been collected beforehand.
+static inline size_t get_num_sampled_seeds(const Index *index, uint32_t sequence_length, size_t num_minimizers) {
+  if (index->minimizer_seeds) {
+    return num_minimizers;
+  }
+  return sequence_length >= (uint32_t)index->kmer_size ? (sequence_length - index->kmer_size) / index->step_size + 1 : 0;
+}
+
+// Returns the position of a sampled seed in its sequence, given the index of
+// the seed and the index of the first seed of the sequence.
+static inline uint32_t get_sampled_seed_position(const Index *index, const kvec_t_uint32_t *minimizer_positions, size_t sequence_seed_offset, size_t seed_index) {
+  if (index->minimizer_seeds) {
+    return kv_A(minimizer_positions->v, seed_index);
+  }
+  return (seed_index - sequence_seed_offset) * index->step_size;
 }
 
 typedef struct {
@@ -54,20 +865,341 @@ KRADIX_SORT_INIT(occurrence_table, uint64_t, OccurrenceTableSortKey, 8);
 //  }
 //}
 
-void construct_index(const SequenceBatch *sequence_batch, Index *index) {
+typedef struct {
+  int thread_id;
+  int num_threads;
+  const SequenceBatch *sequence_batch;
+  Index *index;
+  const size_t *sequence_seed_offsets; // # seeds sampled before each sequence
+  const kvec_t_uint32_t *minimizer_positions; // of all the seeds, for a minimizer-sampled index
+  size_t num_seeds;
+  int digit_shift; // the top digit of a hash value is (hash_value >> digit_shift)
+  int num_digits;
+  size_t *thread_digit_counts; // num_threads x num_digits, turned into write cursors before scattering
+  const size_t *digit_offsets;
+  size_t *next_digit;
+  HashTableEntry *hash_table;
+} ParallelIndexConstructionArgs;
+
+#define SEED_PASS_COUNT_DIGITS 0
+#define SEED_PASS_SCATTER_TO_PARTITIONS 1
+#define SEED_PASS_COUNT_KMERS 2
+#define SEED_PASS_SCATTER_TO_BUCKETS 3
+
+// Hashes the seeds sampled in this thread's slice of the reference. For the
+// sort-based construction, the first pass only counts the top digit of each
+// hash value and the second pass scatters the seeds to their digit partition,
+// so the partitioning needs no extra memory. For the count-then-scatter
+// construction, the passes count k-mers into the lookup table and then place
+// the locations straight into their occurrence buckets.
+static void hash_seeds_in_thread_slice(ParallelIndexConstructionArgs *args, int seed_pass) {
+  size_t seed_start = args->num_seeds / args->num_threads * args->thread_id;
+  size_t seed_end = args->thread_id == args->num_threads - 1 ? args->num_seeds : seed_start + args->num_seeds / args->num_threads;
+  if (seed_start == seed_end) {
+    return;
+  }
+  uint32_t num_sequences = args->sequence_batch->num_loaded_sequences;
+  // Find the sequence which contains the first seed of the slice
+  uint32_t sequence_index = 0;
+  uint32_t high = num_sequences;
+  while (sequence_index + 1 < high) {
+    uint32_t middle = (sequence_index + high) / 2;
+    if (args->sequence_seed_offsets[middle] <= seed_start) {
+      sequence_index = middle;
+    } else {
+      high = middle;
+    }
+  }
+  size_t *digit_counts = args->thread_digit_counts + (size_t)args->thread_id * args->num_digits;
+  uint32_t *lookup_table = args->index->lookup_table;
+  int is_shared = args->num_threads > 1;
+  size_t seed_index = seed_start;
+  for (; sequence_index < num_sequences && seed_index < seed_end; ++sequence_index) {
+    uint32_t sequence_length = get_sequence_length_from_sequence_batch_at(args->sequence_batch, sequence_index);
+    const char *sequence = get_sequence_from_sequence_batch_at(args->sequence_batch, sequence_index);
+    size_t sequence_seed_end = args->sequence_seed_offsets[sequence_index + 1] < seed_end ? args->sequence_seed_offsets[sequence_index + 1] : seed_end;
+    for (; seed_index < sequence_seed_end; ++seed_index) {
+      uint32_t sequence_position = get_sampled_seed_position(args->index, args->minimizer_positions, args->sequence_seed_offsets[sequence_index], seed_index);
+      uint64_t hash_value = hash_seed_in_sequence(sequence_position, args->index->kmer_size, sequence, sequence_length);
+      uint64_t location = get_indexed_seed_location(args->index, sequence_index, sequence_position, &hash_value);
+      if (seed_pass == SEED_PASS_COUNT_DIGITS) {
+        ++digit_counts[hash_value >> args->digit_shift];
+      } else if (seed_pass == SEED_PASS_SCATTER_TO_PARTITIONS) {
+        HashTableEntry *entry = args->hash_table + digit_counts[hash_value >> args->digit_shift]++;
+        entry->hash_value = hash_value;
+        entry->location = location;
+      } else if (seed_pass == SEED_PASS_COUNT_KMERS) {
+        if (is_shared) {
+          __sync_fetch_and_add(lookup_table + hash_value + 1, 1);
+        } else {
+          ++lookup_table[hash_value + 1];
+        }
+      } else {
+        uint32_t occurrence_index = is_shared ? __sync_fetch_and_add(lookup_table + hash_value, 1) : lookup_table[hash_value]++;
+        args->index->occurrence_table[occurrence_index] = location;
+      }
+    }
+  }
+}
+
+static void *count_seed_digits_thread(void *args_v) {
+  hash_seeds_in_thread_slice((ParallelIndexConstructionArgs*)args_v, SEED_PASS_COUNT_DIGITS);
+  return NULL;
+}
+
+static void *scatter_seeds_thread(void *args_v) {
+  hash_seeds_in_thread_slice((ParallelIndexConstructionArgs*)args_v, SEED_PASS_SCATTER_TO_PARTITIONS);
+  return NULL;
+}
+
+static void *count_kmers_thread(void *args_v) {
+  hash_seeds_in_thread_slice((ParallelIndexConstructionArgs*)args_v, SEED_PASS_COUNT_KMERS);
+  return NULL;
+}
+
+static void *scatter_locations_thread(void *args_v) {
+  hash_seeds_in_thread_slice((ParallelIndexConstructionArgs*)args_v, SEED_PASS_SCATTER_TO_BUCKETS);
+  return NULL;
+}
+
+#define NUM_BUCKETS_PER_SORTING_TASK 65536
+
+// Sorts the occurrence buckets in chunks of hash values claimed from a shared counter.
+static void *sort_occurrence_buckets_thread(void *args_v) {
+  ParallelIndexConstructionArgs *args = (ParallelIndexConstructionArgs*)args_v;
+  size_t num_buckets = ((size_t)1) << (2 * args->index->kmer_size);
+  while (1) {
+    size_t bucket_start = __sync_fetch_and_add(args->next_digit, NUM_BUCKETS_PER_SORTING_TASK);
+    if (bucket_start >= num_buckets) {
+      break;
+    }
+    size_t bucket_end = bucket_start + NUM_BUCKETS_PER_SORTING_TASK < num_buckets ? bucket_start + NUM_BUCKETS_PER_SORTING_TASK : num_buckets;
+    for (size_t bucket = bucket_start; bucket < bucket_end; ++bucket) {
+      radix_sort_occurrence_table(args->index->occurrence_table + args->index->lookup_table[bucket], args->index->occurrence_table + args->index->lookup_table[bucket + 1]);
+    }
+  }
+  return NULL;
+}
+
+// Each digit partition holds a disjoint range of hash values, so its part of
+// the lookup table and occurrence table can be built without locking.
+static void *sort_digit_partitions_thread(void *args_v) {
+  ParallelIndexConstructionArgs *args = (ParallelIndexConstructionArgs*)args_v;
+  while (1) {
+    size_t digit = __sync_fetch_and_add(args->next_digit, 1);
+    if (digit >= (size_t)args->num_digits) {
+      break;
+    }
+    HashTableEntry *partition_start = args->hash_table + args->digit_offsets[digit];
+    HashTableEntry *partition_end = args->hash_table + args->digit_offsets[digit + 1];
+    if (args->digit_shift > 0) {
+      if (partition_end - partition_start <= RS_MIN_SIZE) {
+        rs_insertsort_hash_table(partition_start, partition_end);
+      } else {
+        int num_bits = args->digit_shift < RS_MAX_BITS ? args->digit_shift : RS_MAX_BITS;
+        rs_sort_hash_table(partition_start, partition_end, num_bits, args->digit_shift - num_bits);
+      }
+    }
+    uint64_t *occurrences = args->index->occurrence_table + args->digit_offsets[digit];
+    size_t num_entries = partition_end - partition_start;
+    for (size_t i = 0; i < num_entries; ++i) {
+      occurrences[i] = partition_start[i].location;
+    }
+    for (size_t bucket_start = 0; bucket_start < num_entries;) {
+      size_t bucket_end = bucket_start + 1;
+      while (bucket_end < num_entries && partition_start[bucket_end].hash_value == partition_start[bucket_start].hash_value) {
+        ++bucket_end;
+      }
+      args->index->lookup_table[partition_start[bucket_start].hash_value + 1] = bucket_end - bucket_start;
+      radix_sort_occurrence_table(occurrences + bucket_start, occurrences + bucket_end);
+      bucket_start = bucket_end;
+    }
+  }
+  return NULL;
+}
+
+static void run_index_construction_threads(void *(*thread_function)(void *), ParallelIndexConstructionArgs *args) {
+  int num_threads = args[0].num_threads;
+  pthread_t thread_handles[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_create(thread_handles + i, NULL, thread_function, args + i);
+    assert(pthread_err == 0);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_join(thread_handles[i], NULL);
+    assert(pthread_err == 0);
+  }
+}
+
+// Returns the prefix sums of the number of seeds sampled in each reference
+// sequence. For a minimizer-sampled index, the positions of all the seeds are
+// collected into minimizer_positions, 4 bytes per seed on top of the index.
+static size_t *compute_sequence_seed_offsets(const SequenceBatch *sequence_batch, const Index *index, kvec_t_uint32_t *minimizer_positions) {
+  uint32_t num_sequences = sequence_batch->num_loaded_sequences;
+  size_t *sequence_seed_offsets = (size_t*)malloc(sizeof(size_t) * (num_sequences + 1));
+  assert(sequence_seed_offsets);
+  sequence_seed_offsets[0] = 0;
+  for (uint32_t sequence_index = 0; sequence_index < num_sequences; ++sequence_index) {
+    uint32_t sequence_length = get_sequence_length_from_sequence_batch_at(sequence_batch, sequence_index);
+    if (index->minimizer_seeds) {
+      collect_minimizer_positions(index, get_sequence_from_sequence_batch_at(sequence_batch, sequence_index), sequence_length, minimizer_positions);
+    }
+    sequence_seed_offsets[sequence_index + 1] = sequence_seed_offsets[sequence_index] + get_num_sampled_seeds(index, sequence_length, kv_size(minimizer_positions->v) - sequence_seed_offsets[sequence_index]);
+  }
+  return sequence_seed_offsets;
+}
+
+// Same index as the single-threaded construction: seeds are hashed in parallel
+// and partitioned by the top digit of their hash values (MSD radix sort), then
+// the partitions are sorted and turned into lookup and occurrence table
+// entries in parallel.
+static void construct_index_in_parallel(const SequenceBatch *sequence_batch, Index *index) {
+  double real_start_time = get_real_time();
+  int num_threads = index->num_threads;
+  kvec_t_uint32_t minimizer_positions;
+  kv_init(minimizer_positions.v);
+  size_t *sequence_seed_offsets = compute_sequence_seed_offsets(sequence_batch, index, &minimizer_positions);
+  size_t num_seeds = sequence_seed_offsets[sequence_batch->num_loaded_sequences];
+  int num_hash_bits = 2 * index->kmer_size;
+  int digit_bits = num_hash_bits < RS_MAX_BITS ? num_hash_bits : RS_MAX_BITS;
+  int num_digits = 1 << digit_bits;
+  size_t *thread_digit_counts = (size_t*)calloc((size_t)num_threads * num_digits, sizeof(size_t));
+  size_t *digit_offsets = (size_t*)calloc(num_digits + 1, sizeof(size_t));
+  size_t next_digit = 0;
+  HashTableEntry *hash_table = (HashTableEntry*)malloc(sizeof(HashTableEntry) * (num_seeds + 1));
+  assert(thread_digit_counts && digit_offsets && hash_table);
+  ParallelIndexConstructionArgs args[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    args[i].thread_id = i;
+    args[i].num_threads = num_threads;
+    args[i].sequence_batch = sequence_batch;
+    args[i].index = index;
+    args[i].sequence_seed_offsets = sequence_seed_offsets;
+    args[i].minimizer_positions = &minimizer_positions;
+    args[i].num_seeds = num_seeds;
+    args[i].digit_shift = num_hash_bits - digit_bits;
+    args[i].num_digits = num_digits;
+    args[i].thread_digit_counts = thread_digit_counts;
+    args[i].digit_offsets = digit_offsets;
+    args[i].next_digit = &next_digit;
+    args[i].hash_table = hash_table;
+  }
+  run_index_construction_threads(count_seed_digits_thread, args);
+  // Turn the per-thread digit counts into write cursors. Threads scatter their
+  // slices in reference order, so each partition stays ordered by location.
+  for (int digit = 0; digit < num_digits; ++digit) {
+    size_t cursor = digit_offsets[digit];
+    for (int thread_id = 0; thread_id < num_threads; ++thread_id) {
+      size_t count = thread_digit_counts[(size_t)thread_id * num_digits + digit];
+      thread_digit_counts[(size_t)thread_id * num_digits + digit] = cursor;
+      cursor += count;
+    }
+    digit_offsets[digit + 1] = cursor;
+  }
+  assert(digit_offsets[num_digits] == num_seeds);
+  run_index_construction_threads(scatter_seeds_thread, args);
+  fprintf(stderr, "Collected %ld seeds.\n", num_seeds);
+  size_t lookup_table_size = (1 << (2 * index->kmer_size)) + 1;
+  index->lookup_table = (uint32_t*)calloc(lookup_table_size, sizeof(uint32_t));
+  assert(index->lookup_table);
+  index->occurrence_table_size = num_seeds;
+  index->occurrence_table = (uint64_t*)malloc(sizeof(uint64_t) * index->occurrence_table_size);
+  assert(index->occurrence_table);
+  run_index_construction_threads(sort_digit_partitions_thread, args);
+  fprintf(stderr, "Sorted all the seeds.\n");
+  free(hash_table);
+  free(digit_offsets);
+  free(thread_digit_counts);
+  free(sequence_seed_offsets);
+  kv_destroy(minimizer_positions.v);
+  for (size_t i = 1; i < lookup_table_size; i++) {
+    index->lookup_table[i] += index->lookup_table[i - 1];
+  }
+  assert(index->lookup_table[lookup_table_size - 1] == num_seeds);
+  fprintf(stderr, "Lookup table size: %ld, occurrence table size: %ld.\n", lookup_table_size, index->occurrence_table_size);
+  fprintf(stderr, "Built index with %d threads in %fs.\n", num_threads, get_real_time() - real_start_time);
+}
+
+// Builds the index without the temporary hash table: k-mers are first counted
+// straight into the lookup table, then, after a prefix sum, each location is
+// written to its bucket. Peak memory is the final index. With a single thread
+// the locations arrive in reference order, so the buckets of a non-canonical
+// index need no sorting.
+static void construct_index_by_counting(const SequenceBatch *sequence_batch, Index *index) {
+  double real_start_time = get_real_time();
+  int num_threads = index->num_threads;
+  kvec_t_uint32_t minimizer_positions;
+  kv_init(minimizer_positions.v);
+  size_t *sequence_seed_offsets = compute_sequence_seed_offsets(sequence_batch, index, &minimizer_positions);
+  size_t num_seeds = sequence_seed_offsets[sequence_batch->num_loaded_sequences];
+  size_t lookup_table_size = (1 << (2 * index->kmer_size)) + 1;
+  index->lookup_table = (uint32_t*)calloc(lookup_table_size, sizeof(uint32_t));
+  assert(index->lookup_table);
+  index->occurrence_table_size = num_seeds;
+  index->occurrence_table = (uint64_t*)malloc(sizeof(uint64_t) * index->occurrence_table_size);
+  assert(index->occurrence_table);
+  size_t next_bucket = 0;
+  ParallelIndexConstructionArgs args[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    args[i].thread_id = i;
+    args[i].num_threads = num_threads;
+    args[i].sequence_batch = sequence_batch;
+    args[i].index = index;
+    args[i].sequence_seed_offsets = sequence_seed_offsets;
+    args[i].minimizer_positions = &minimizer_positions;
+    args[i].num_seeds = num_seeds;
+    args[i].digit_shift = 0;
+    args[i].num_digits = 0;
+    args[i].thread_digit_counts = NULL;
+    args[i].digit_offsets = NULL;
+    args[i].next_digit = &next_bucket;
+    args[i].hash_table = NULL;
+  }
+  run_index_construction_threads(count_kmers_thread, args);
+  fprintf(stderr, "Counted %ld seeds.\n", num_seeds);
+  for (size_t i = 1; i < lookup_table_size; i++) {
+    index->lookup_table[i] += index->lookup_table[i - 1];
+  }
+  assert(index->lookup_table[lookup_table_size - 1] == num_seeds);
+  // lookup_table[i] is the write cursor of bucket i. After the scatter it
+  // points to the end of the bucket, so shift it back by one entry.
+  run_index_construction_threads(scatter_locations_thread, args);
+  for (size_t i = lookup_table_size - 1; i > 0; i--) {
+    index->lookup_table[i] = index->lookup_table[i - 1];
+  }
+  index->lookup_table[0] = 0;
+  free(sequence_seed_offsets);
+  kv_destroy(minimizer_positions.v);
+  // Canonical locations arrive with their strand bits mixed, so their buckets
+  // are sorted even with one thread.
+  if (num_threads > 1 || index->canonical_seeds) {
+    run_index_construction_threads(sort_occurrence_buckets_thread, args);
+  }
+  fprintf(stderr, "Lookup table size: %ld, occurrence table size: %ld.\n", lookup_table_size, index->occurrence_table_size);
+  fprintf(stderr, "Built index by counting with %d threads in %fs.\n", num_threads, get_real_time() - real_start_time);
+}
+
+static void construct_index_by_sorting(const SequenceBatch *sequence_batch, Index *index) {
   double real_start_time = get_real_time();
-  HashTableEntry* tmp_hash_table = (HashTableEntry*) malloc(sizeof(HashTableEntry) * (sequence_batch->num_bases / index->step_size + 1));
+  kvec_t_uint32_t minimizer_positions;
+  kv_init(minimizer_positions.v);
+  size_t *sequence_seed_offsets = compute_sequence_seed_offsets(sequence_batch, index, &minimizer_positions);
+  HashTableEntry* tmp_hash_table = (HashTableEntry*) malloc(sizeof(HashTableEntry) * (sequence_seed_offsets[sequence_batch->num_loaded_sequences] + 1));
   size_t num_tmp_hash_table_entries = 0;
   //Compute hash value of each element
   for (uint32_t sequence_index = 0; sequence_index < sequence_batch->num_loaded_sequences; ++sequence_index) {
     uint32_t sequence_length = get_sequence_length_from_sequence_batch_at(sequence_batch, sequence_index);
     const char *sequence = get_sequence_from_sequence_batch_at(sequence_batch, sequence_index);
-    for (uint32_t sequence_position = 0; sequence_position + index->kmer_size - 1 < sequence_length; sequence_position += index->step_size) {
-      tmp_hash_table[num_tmp_hash_table_entries].hash_value = hash_seed_in_sequence(sequence_position, index->kmer_size, sequence, sequence_length);
-      tmp_hash_table[num_tmp_hash_table_entries].location = ((uint64_t)sequence_index) << 32 | (uint32_t)sequence_position;
+    for (size_t seed_index = sequence_seed_offsets[sequence_index]; seed_index < sequence_seed_offsets[sequence_index + 1]; ++seed_index) {
+      uint32_t sequence_position = get_sampled_seed_position(index, &minimizer_positions, sequence_seed_offsets[sequence_index], seed_index);
+      uint64_t hash_value = hash_seed_in_sequence(sequence_position, index->kmer_size, sequence, sequence_length);
+      tmp_hash_table[num_tmp_hash_table_entries].location = get_indexed_seed_location(index, sequence_index, sequence_position, &hash_value);
+      tmp_hash_table[num_tmp_hash_table_entries].hash_value = hash_value;
       ++num_tmp_hash_table_entries;
     }
   }
+  free(sequence_seed_offsets);
+  kv_destroy(minimizer_positions.v);
   fprintf(stderr, "Collected %ld seeds.\n", num_tmp_hash_table_entries);
   // Sort hash table
   //qsort(tmp_hash_table, num_tmp_hash_table_entries, sizeof(HashTableEntry), compare_hash_table_entry);
@@ -97,19 +1229,555 @@ void construct_index(const SequenceBatch *sequence_batch, Index *index) {
   fprintf(stderr, "Built index in %fs.\n", get_real_time() - real_start_time);
 }
 
-void load_index(const char *index_file_path, Index *index) {
+typedef struct {
+  uint64_t hash_value;
+  uint64_t location;
+} SparseHashTableEntry;
+
+#define SparseHashTableSortKey(m) ((m).hash_value)
+KRADIX_SORT_INIT(sparse_hash_table, SparseHashTableEntry, SparseHashTableSortKey, 8);
+
+// Builds the sparse lookup table for k-mers up to 32 bases: seeds are sorted
+// by their 64-bit codes, and each distinct code gets a sorted suffix and a
+// 64-bit offset into the occurrence table.
+static void construct_sparse_index(const SequenceBatch *sequence_batch, Index *index) {
   double real_start_time = get_real_time();
-  index->index_file = fopen(index_file_path, "rb");
-  if (index->index_file == NULL) {
-    fprintf(stderr, "Failed to open index file %s\n", index_file_path);
-    exit(EXIT_FAILURE);
+  kvec_t_uint32_t minimizer_positions;
+  kv_init(minimizer_positions.v);
+  size_t *sequence_seed_offsets = compute_sequence_seed_offsets(sequence_batch, index, &minimizer_positions);
+  SparseHashTableEntry *tmp_hash_table = (SparseHashTableEntry*)malloc(sizeof(SparseHashTableEntry) * (sequence_seed_offsets[sequence_batch->num_loaded_sequences] + 1));
+  assert(tmp_hash_table);
+  size_t num_seeds = 0;
+  for (uint32_t sequence_index = 0; sequence_index < sequence_batch->num_loaded_sequences; ++sequence_index) {
+    uint32_t sequence_length = get_sequence_length_from_sequence_batch_at(sequence_batch, sequence_index);
+    const char *sequence = get_sequence_from_sequence_batch_at(sequence_batch, sequence_index);
+    for (size_t seed_index = sequence_seed_offsets[sequence_index]; seed_index < sequence_seed_offsets[sequence_index + 1]; ++seed_index) {
+      uint32_t sequence_position = get_sampled_seed_position(index, &minimizer_positions, sequence_seed_offsets[sequence_index], seed_index);
+      if (index->skip_ambiguous_seeds && seed_has_ambiguous_base(sequence_position, index->kmer_size, sequence)) {
+        continue;
+      }
+      uint64_t hash_value = hash_seed_in_sequence(sequence_position, index->kmer_size, sequence, sequence_length);
+      tmp_hash_table[num_seeds].location = get_indexed_seed_location(index, sequence_index, sequence_position, &hash_value);
+      tmp_hash_table[num_seeds].hash_value = hash_value;
+      ++num_seeds;
+    }
   }
-  size_t num_read_elements = fread(&(index->kmer_size), sizeof(int), 1, index->index_file); //TODO: check fread return value
-  if (num_read_elements != 1) {
-    fprintf(stderr, "Load error while initializing hash table.\n");
-    exit(EXIT_FAILURE);
+  free(sequence_seed_offsets);
+  kv_destroy(minimizer_positions.v);
+  fprintf(stderr, "Collected %ld seeds.\n", num_seeds);
+  radix_sort_sparse_hash_table(tmp_hash_table, tmp_hash_table + num_seeds);
+  fprintf(stderr, "Sorted all the seeds.\n");
+  size_t num_distinct_seeds = 0;
+  for (size_t i = 0; i < num_seeds; ++i) {
+    if (i == 0 || tmp_hash_table[i].hash_value != tmp_hash_table[i - 1].hash_value) {
+      ++num_distinct_seeds;
+    }
   }
-  num_read_elements = fread(&(index->step_size), sizeof(int), 1, index->index_file);
+  index->num_distinct_seeds = num_distinct_seeds;
+  index->sparse_prefix_bits = choose_sparse_prefix_bits(index->kmer_size, num_distinct_seeds);
+  int suffix_bits = get_sparse_suffix_bits(index);
+  size_t directory_size = (((size_t)1) << index->sparse_prefix_bits) + 1;
+  index->sparse_directory = (uint64_t*)calloc(directory_size, sizeof(uint64_t));
+  index->sparse_suffixes = malloc(get_sparse_suffix_size(index) * (num_distinct_seeds > 0 ? num_distinct_seeds : 1));
+  index->sparse_occurrence_offsets = (uint64_t*)malloc(sizeof(uint64_t) * (num_distinct_seeds + 1));
+  index->occurrence_table_size = num_seeds;
+  index->occurrence_table = (uint64_t*)malloc(sizeof(uint64_t) * (num_seeds > 0 ? num_seeds : 1));
+  assert(index->sparse_directory && index->sparse_suffixes && index->sparse_occurrence_offsets && index->occurrence_table);
+  uint64_t suffix_mask = suffix_bits >= 64 ? ~((uint64_t)0) : (((uint64_t)1) << suffix_bits) - 1;
+  size_t seed_index = 0;
+  for (size_t i = 0; i < num_seeds; ++i) {
+    index->occurrence_table[i] = tmp_hash_table[i].location;
+    if (i > 0 && tmp_hash_table[i].hash_value == tmp_hash_table[i - 1].hash_value) {
+      continue;
+    }
+    if (i > 0) {
+      radix_sort_occurrence_table(index->occurrence_table + index->sparse_occurrence_offsets[seed_index - 1], index->occurrence_table + i);
+    }
+    uint64_t hash_value = tmp_hash_table[i].hash_value;
+    uint64_t prefix = suffix_bits >= 64 ? 0 : hash_value >> suffix_bits;
+    ++index->sparse_directory[prefix + 1];
+    if (suffix_bits > 32) {
+      ((uint64_t*)index->sparse_suffixes)[seed_index] = hash_value & suffix_mask;
+    } else {
+      ((uint32_t*)index->sparse_suffixes)[seed_index] = hash_value & suffix_mask;
+    }
+    index->sparse_occurrence_offsets[seed_index] = i;
+    ++seed_index;
+  }
+  if (num_seeds > 0) {
+    radix_sort_occurrence_table(index->occurrence_table + index->sparse_occurrence_offsets[seed_index - 1], index->occurrence_table + num_seeds);
+  }
+  index->sparse_occurrence_offsets[num_distinct_seeds] = num_seeds;
+  for (size_t i = 1; i < directory_size; ++i) {
+    index->sparse_directory[i] += index->sparse_directory[i - 1];
+  }
+  free(tmp_hash_table);
+  fprintf(stderr, "Distinct k-mers: %ld, prefix bits: %d, occurrence table size: %ld.\n", num_distinct_seeds, index->sparse_prefix_bits, num_seeds);
+  fprintf(stderr, "Built sparse index in %fs.\n", get_real_time() - real_start_time);
+}
+
+void construct_index(const SequenceBatch *sequence_batch, Index *index) {
+  if (index->embed_reference) {
+    pack_sequence_batch(sequence_batch, &(index->reference));
+  }
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    construct_sparse_index(sequence_batch, index);
+    return;
+  }
+  int occurrence_table_encoding = index->occurrence_table_encoding;
+  index->occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_LOCATION;
+  if (index->construction_method == INDEX_CONSTRUCTION_BY_COUNTING) {
+    construct_index_by_counting(sequence_batch, index);
+  } else if (index->num_threads > 1) {
+    construct_index_in_parallel(sequence_batch, index);
+  } else {
+    construct_index_by_sorting(sequence_batch, index);
+  }
+  if (index->skip_ambiguous_seeds) {
+    remove_ambiguous_seeds(sequence_batch, index);
+  }
+  if (index->max_bucket_size > 0) {
+    extract_repeat_buckets(index);
+  }
+  if (occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+    compress_occurrence_table(sequence_batch, index);
+  } else if (occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION) {
+    compact_occurrence_table(sequence_batch, index);
+  }
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_ELIAS_FANO) {
+    // The dense table is still needed to build the index, so only its copy in
+    // the index file and in FEM map shrinks.
+    double real_start_time = get_real_time();
+    size_t lookup_table_size = (((size_t)1) << (2 * index->kmer_size)) + 1;
+    construct_elias_fano_sequence(index->lookup_table, lookup_table_size, &(index->succinct_lookup_table));
+    free(index->lookup_table);
+    index->lookup_table = NULL;
+    fprintf(stderr, "Encoded lookup table in %.2f MB instead of %.2f MB in %fs.\n", get_lookup_table_size_in_bytes(index) / 1048576.0, sizeof(uint32_t) * lookup_table_size / 1048576.0, get_real_time() - real_start_time);
+  }
+}
+
+typedef struct {
+  const Index *first_index;
+  const Index *second_index;
+  Index *merged_index;
+  uint64_t hash_value_start;
+  uint64_t hash_value_end;
+} IndexMergeArgs;
+
+// The sequences of the second index follow those of the first one, so its
+// occurrences sort after the first index's in every bucket once their sequence
+// indices are shifted, and each merged bucket is the two buckets one after the
+// other.
+static void *merge_buckets_thread(void *index_merge_args_v) {
+  IndexMergeArgs *args = (IndexMergeArgs*)index_merge_args_v;
+  const Index *first_index = args->first_index;
+  const Index *second_index = args->second_index;
+  Index *merged_index = args->merged_index;
+  uint64_t sequence_index_shift = ((uint64_t)first_index->reference.num_sequences) << 32;
+  for (uint64_t hash_value = args->hash_value_start; hash_value < args->hash_value_end; ++hash_value) {
+    uint64_t *merged_occurrences = merged_index->occurrence_table + merged_index->lookup_table[hash_value];
+    const uint64_t *first_occurrences = first_index->occurrence_table + first_index->lookup_table[hash_value];
+    uint32_t first_bucket_size = first_index->lookup_table[hash_value + 1] - first_index->lookup_table[hash_value];
+    const uint64_t *second_occurrences = second_index->occurrence_table + second_index->lookup_table[hash_value];
+    uint32_t second_bucket_size = second_index->lookup_table[hash_value + 1] - second_index->lookup_table[hash_value];
+    // A canonical bucket is merged one strand at a time, so that the reverse
+    // strand occurrences of both indexes stay at the end.
+    uint32_t first_strand_sizes[2] = {first_bucket_size, 0};
+    uint32_t second_strand_sizes[2] = {second_bucket_size, 0};
+    if (merged_index->canonical_seeds) {
+      first_strand_sizes[0] = get_num_forward_strand_occurrences(first_occurrences, first_bucket_size);
+      first_strand_sizes[1] = first_bucket_size - first_strand_sizes[0];
+      second_strand_sizes[0] = get_num_forward_strand_occurrences(second_occurrences, second_bucket_size);
+      second_strand_sizes[1] = second_bucket_size - second_strand_sizes[0];
+    }
+    for (int strand = 0; strand < 2; ++strand) {
+      memcpy(merged_occurrences, first_occurrences, sizeof(uint64_t) * first_strand_sizes[strand]);
+      merged_occurrences += first_strand_sizes[strand];
+      first_occurrences += first_strand_sizes[strand];
+      for (uint32_t i = 0; i < second_strand_sizes[strand]; ++i) {
+        merged_occurrences[i] = second_occurrences[i] + sequence_index_shift;
+      }
+      merged_occurrences += second_strand_sizes[strand];
+      second_occurrences += second_strand_sizes[strand];
+    }
+  }
+  return NULL;
+}
+
+void merge_indexes(const Index *first_index, const Index *second_index, Index *merged_index) {
+  const Index *indexes[2] = {first_index, second_index};
+  for (int i = 0; i < 2; ++i) {
+    if (indexes[i]->lookup_table_encoding != INDEX_LOOKUP_TABLE_DENSE || indexes[i]->occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION || indexes[i]->max_bucket_size > 0) {
+      fprintf(stderr, "%s\n", "Only indexes built without --compact, --compress, --succinct, --sparse and --max-bucket-size can be merged.");
+      exit(EXIT_FAILURE);
+    }
+    if (indexes[i]->reference.num_sequences == 0) {
+      fprintf(stderr, "%s\n", "Only indexes with an embedded reference can be merged.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (first_index->kmer_size != second_index->kmer_size || first_index->step_size != second_index->step_size || first_index->skip_ambiguous_seeds != second_index->skip_ambiguous_seeds || first_index->canonical_seeds != second_index->canonical_seeds || first_index->minimizer_seeds != second_index->minimizer_seeds) {
+    fprintf(stderr, "Cannot merge an index with window size %d and step size %d%s%s%s into one with window size %d and step size %d%s%s%s.\n", second_index->kmer_size, second_index->step_size, second_index->skip_ambiguous_seeds ? " skipping ambiguous seeds" : "", second_index->canonical_seeds ? " with canonical seeds" : "", second_index->minimizer_seeds ? " with minimizer seeds" : "", first_index->kmer_size, first_index->step_size, first_index->skip_ambiguous_seeds ? " skipping ambiguous seeds" : "", first_index->canonical_seeds ? " with canonical seeds" : "", first_index->minimizer_seeds ? " with minimizer seeds" : "");
+    exit(EXIT_FAILURE);
+  }
+  if ((uint64_t)first_index->occurrence_table_size + second_index->occurrence_table_size > UINT32_MAX || (uint64_t)first_index->reference.num_sequences + second_index->reference.num_sequences > UINT32_MAX) {
+    fprintf(stderr, "%s\n", "The merged index would be too large.");
+    exit(EXIT_FAILURE);
+  }
+  double real_start_time = get_real_time();
+  merged_index->kmer_size = first_index->kmer_size;
+  merged_index->step_size = first_index->step_size;
+  merged_index->skip_ambiguous_seeds = first_index->skip_ambiguous_seeds;
+  merged_index->canonical_seeds = first_index->canonical_seeds;
+  merged_index->minimizer_seeds = first_index->minimizer_seeds;
+  merged_index->lookup_table_encoding = INDEX_LOOKUP_TABLE_DENSE;
+  merged_index->occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_LOCATION;
+  size_t lookup_table_size = (((size_t)1) << (2 * merged_index->kmer_size)) + 1;
+  merged_index->lookup_table = (uint32_t*)malloc(sizeof(uint32_t) * lookup_table_size);
+  assert(merged_index->lookup_table);
+  for (size_t hash_value = 0; hash_value < lookup_table_size; ++hash_value) {
+    merged_index->lookup_table[hash_value] = first_index->lookup_table[hash_value] + second_index->lookup_table[hash_value];
+  }
+  merged_index->occurrence_table_size = first_index->occurrence_table_size + second_index->occurrence_table_size;
+  merged_index->occurrence_table = (uint64_t*)malloc(sizeof(uint64_t) * merged_index->occurrence_table_size);
+  assert(merged_index->occurrence_table);
+  int num_threads = merged_index->num_threads > 0 ? merged_index->num_threads : 1;
+  uint64_t num_hash_values = lookup_table_size - 1;
+  pthread_t merge_thread_handles[num_threads];
+  IndexMergeArgs merge_args[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    merge_args[i].first_index = first_index;
+    merge_args[i].second_index = second_index;
+    merge_args[i].merged_index = merged_index;
+    merge_args[i].hash_value_start = num_hash_values * i / num_threads;
+    merge_args[i].hash_value_end = num_hash_values * (i + 1) / num_threads;
+    int pthread_err = pthread_create(merge_thread_handles + i, NULL, merge_buckets_thread, merge_args + i);
+    assert(pthread_err == 0);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_join(merge_thread_handles[i], NULL);
+    assert(pthread_err == 0);
+  }
+  append_packed_reference(&(first_index->reference), &(merged_index->reference));
+  append_packed_reference(&(second_index->reference), &(merged_index->reference));
+  fprintf(stderr, "Merged %ld and %ld occurrences of %d and %d sequences in %fs.\n", first_index->occurrence_table_size, second_index->occurrence_table_size, first_index->reference.num_sequences, second_index->reference.num_sequences, get_real_time() - real_start_time);
+}
+
+typedef struct {
+  const uint8_t *pages;
+  size_t size;
+  volatile uint8_t checksum;
+} PrefaultArgs;
+
+static void *prefault_thread(void *prefault_args_v) {
+  PrefaultArgs *prefault_args = (PrefaultArgs*)prefault_args_v;
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < prefault_args->size; i += INDEX_FILE_ALIGNMENT) {
+    checksum ^= prefault_args->pages[i];
+  }
+  prefault_args->checksum = checksum;
+  return NULL;
+}
+
+// Faults in every page of the mapping with num_threads threads, each touching one contiguous slice.
+static void prefault_mapped_index(const Index *index) {
+  int num_threads = index->num_threads > 0 ? index->num_threads : 1;
+  size_t slice_size = (index->mapped_index_size / num_threads + INDEX_FILE_ALIGNMENT - 1) / INDEX_FILE_ALIGNMENT * INDEX_FILE_ALIGNMENT;
+  madvise(index->mapped_index, index->mapped_index_size, MADV_WILLNEED);
+  pthread_t prefault_thread_handles[num_threads];
+  PrefaultArgs prefault_args[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    size_t slice_start = slice_size * i < index->mapped_index_size ? slice_size * i : index->mapped_index_size;
+    size_t slice_end = slice_start + slice_size < index->mapped_index_size ? slice_start + slice_size : index->mapped_index_size;
+    prefault_args[i].pages = (const uint8_t*)index->mapped_index + slice_start;
+    prefault_args[i].size = slice_end - slice_start;
+    int pthread_err = pthread_create(prefault_thread_handles + i, NULL, prefault_thread, prefault_args + i);
+    assert(pthread_err == 0);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_join(prefault_thread_handles[i], NULL);
+    assert(pthread_err == 0);
+  }
+}
+
+static inline int check_index_file_section(const IndexFileSection *section, size_t expected_size, size_t file_size) {
+  return section->size == expected_size && section->offset % INDEX_FILE_ALIGNMENT == 0 && section->offset <= file_size && section->size <= file_size - section->offset;
+}
+
+static inline int check_index_section(const IndexFileHeader *header, int section_id, size_t expected_size, size_t file_size) {
+  return check_index_file_section(&(header->sections[section_id]), expected_size, file_size);
+}
+
+static void map_embedded_reference(const char *index_file_path, const IndexFileHeader *header, Index *index) {
+  PackedReference *reference = &(index->reference);
+  destroy_packed_reference(reference);
+  reference->is_mapped = 1;
+  reference->num_sequences = header->num_reference_sequences;
+  reference->num_bases = header->num_reference_bases;
+  const IndexFileSection *sections = header->reference_sections;
+  size_t names_size = sections[INDEX_REFERENCE_SECTION_NAMES].size;
+  if (!check_index_file_section(sections + INDEX_REFERENCE_SECTION_NAMES, names_size, index->mapped_index_size) || !check_index_file_section(sections + INDEX_REFERENCE_SECTION_SEQUENCE_OFFSETS, sizeof(uint64_t) * (reference->num_sequences + 1), index->mapped_index_size) || !check_index_file_section(sections + INDEX_REFERENCE_SECTION_PACKED_BASES, sizeof(uint64_t) * get_num_packed_base_words(reference->num_bases), index->mapped_index_size) || !check_index_file_section(sections + INDEX_REFERENCE_SECTION_AMBIGUOUS_BASES, sizeof(uint64_t) * get_num_ambiguous_base_words(reference->num_bases), index->mapped_index_size)) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  reference->names.v.a = (char*)index->mapped_index + sections[INDEX_REFERENCE_SECTION_NAMES].offset;
+  reference->names.v.n = names_size;
+  reference->sequence_offsets.v.a = (uint64_t*)((uint8_t*)index->mapped_index + sections[INDEX_REFERENCE_SECTION_SEQUENCE_OFFSETS].offset);
+  reference->sequence_offsets.v.n = reference->num_sequences + 1;
+  reference->packed_bases.v.a = (uint64_t*)((uint8_t*)index->mapped_index + sections[INDEX_REFERENCE_SECTION_PACKED_BASES].offset);
+  reference->packed_bases.v.n = get_num_packed_base_words(reference->num_bases);
+  reference->ambiguous_bases.v.a = (uint64_t*)((uint8_t*)index->mapped_index + sections[INDEX_REFERENCE_SECTION_AMBIGUOUS_BASES].offset);
+  reference->ambiguous_bases.v.n = get_num_ambiguous_base_words(reference->num_bases);
+  // Every name must be terminated and the offsets must cover the bases.
+  size_t num_names = 0;
+  for (size_t i = 0; i < names_size; ++i) {
+    num_names += reference->names.v.a[i] == '\0';
+  }
+  if (num_names != reference->num_sequences || (names_size > 0 && reference->names.v.a[names_size - 1] != '\0') || kv_A(reference->sequence_offsets.v, 0) != 0 || kv_A(reference->sequence_offsets.v, reference->num_sequences) != reference->num_bases) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void attach_index_sections(const char *index_file_path, Index *index);
+
+static void map_index(const char *index_file_path, Index *index) {
+  ParallelFile index_file;
+  struct stat index_file_stat;
+  if (!open_parallel_file_for_reading(index_file_path, index->num_threads, index->direct_io, &index_file) || fstat(index_file.fd, &index_file_stat) != 0) {
+    fprintf(stderr, "Failed to open index file %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  int fd = index_file.fd;
+  index->mapped_index_size = index_file_stat.st_size;
+  if (!is_default_memory_placement(&(index->memory_placement)) || index->prefault_mode == INDEX_PREFAULT_READ || index->direct_io) {
+    // Page cache pages are small and sit wherever the file was read, so the
+    // index is copied into memory with the requested placement instead. The
+    // chunks are read by all the threads, which keeps a fast disk busy.
+    double real_start_time = get_real_time();
+    index->mapped_index = allocate_placed_memory(index->mapped_index_size, &(index->memory_placement), &(index->placed_index_size));
+    if (!read_parallel_file(&index_file, index->mapped_index, index->mapped_index_size, 0)) {
+      fprintf(stderr, "Failed to read index file %s\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    close_parallel_file(&index_file);
+    fprintf(stderr, "Read %.2f MB of index with %d threads in %fs.\n", index->mapped_index_size / 1048576.0, index_file.num_threads, get_real_time() - real_start_time);
+  } else {
+    int mmap_flags = MAP_SHARED;
+    if (index->prefault_mode == INDEX_PREFAULT_POPULATE) {
+      mmap_flags |= MAP_POPULATE;
+    }
+    index->mapped_index = mmap(NULL, index->mapped_index_size, PROT_READ, mmap_flags, fd, 0);
+    close_parallel_file(&index_file);
+    if (index->mapped_index == MAP_FAILED) {
+      fprintf(stderr, "Failed to map index file %s\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+  }
+  attach_index_sections(index_file_path, index);
+}
+
+// Points the tables of the index into the loaded file image after checking
+// that every section lies inside it.
+static void attach_index_sections(const char *index_file_path, Index *index) {
+  const IndexFileHeader *header = (const IndexFileHeader*)index->mapped_index;
+  if (index->mapped_index_size < INDEX_FILE_ALIGNMENT || header->version != INDEX_FILE_VERSION) {
+    fprintf(stderr, "Unsupported index file version in %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  if ((header->flags & ~INDEX_KNOWN_FLAGS) != 0 || header->occurrence_table_encoding > INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS || header->lookup_table_encoding > INDEX_LOOKUP_TABLE_SPARSE) {
+    fprintf(stderr, "Index file %s uses features this version of FEM does not support.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  index->kmer_size = header->kmer_size;
+  index->step_size = header->step_size;
+  index->occurrence_table_size = header->occurrence_table_size;
+  index->occurrence_table_encoding = header->occurrence_table_encoding;
+  index->num_sequences = header->num_sequences;
+  index->lookup_table_encoding = header->lookup_table_encoding;
+  index->compressed_occurrence_table_size = header->compressed_occurrence_table_size;
+  index->max_bucket_size = header->max_bucket_size;
+  index->keep_repeat_occurrences = !(header->flags & INDEX_FLAG_REPEAT_OCCURRENCES_DROPPED);
+  index->num_repeat_buckets = header->num_repeat_buckets;
+  index->repeat_occurrence_table_size = header->repeat_occurrence_table_size;
+  index->skip_ambiguous_seeds = (header->flags & INDEX_FLAG_AMBIGUOUS_SEEDS_SKIPPED) != 0;
+  index->canonical_seeds = (header->flags & INDEX_FLAG_CANONICAL_SEEDS) != 0;
+  index->minimizer_seeds = (header->flags & INDEX_FLAG_MINIMIZER_SEEDS) != 0;
+  if (index->kmer_size < 1 || index->step_size < 1 || index->kmer_size > INDEX_MAX_SPARSE_KMER_SIZE || (index->kmer_size > INDEX_MAX_DENSE_KMER_SIZE && index->lookup_table_encoding != INDEX_LOOKUP_TABLE_SPARSE) || (index->canonical_seeds && index->occurrence_table_encoding != INDEX_OCCURRENCE_TABLE_LOCATION)) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  size_t lookup_table_size = index->kmer_size > INDEX_MAX_DENSE_KMER_SIZE ? 0 : (((size_t)1) << (2 * index->kmer_size)) + 1;
+  if (!check_index_section(header, INDEX_SECTION_OCCURRENCE_TABLE, get_occurrence_table_size_in_bytes(index), index->mapped_index_size)) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    index->num_distinct_seeds = header->num_distinct_seeds;
+    index->sparse_prefix_bits = header->sparse_prefix_bits;
+    if (index->sparse_prefix_bits < 1 || index->sparse_prefix_bits > INDEX_MAX_SPARSE_PREFIX_BITS || index->sparse_prefix_bits > 2 * index->kmer_size || !check_index_section(header, INDEX_SECTION_SPARSE_DIRECTORY, sizeof(uint64_t) * ((((size_t)1) << index->sparse_prefix_bits) + 1), index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_SPARSE_SUFFIXES, get_sparse_suffix_size(index) * index->num_distinct_seeds, index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_SPARSE_OCCURRENCE_OFFSETS, sizeof(uint64_t) * (index->num_distinct_seeds + 1), index->mapped_index_size)) {
+      fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    index->sparse_directory = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_SPARSE_DIRECTORY].offset);
+    index->sparse_suffixes = (uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_SPARSE_SUFFIXES].offset;
+    index->sparse_occurrence_offsets = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_SPARSE_OCCURRENCE_OFFSETS].offset);
+  } else if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_ELIAS_FANO) {
+    EliasFanoSequence *succinct_lookup_table = &(index->succinct_lookup_table);
+    initialize_elias_fano_sequence(lookup_table_size, index->occurrence_table_size, succinct_lookup_table);
+    succinct_lookup_table->num_sparse_select_positions = header->sections[INDEX_SECTION_LOOKUP_TABLE_SPARSE_SELECT_POSITIONS].size / sizeof(uint64_t);
+    if (succinct_lookup_table->num_low_bits != (int)header->lookup_table_num_low_bits || !check_index_section(header, INDEX_SECTION_LOOKUP_TABLE_LOW_BITS, sizeof(uint64_t) * succinct_lookup_table->num_low_bit_words, index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_LOOKUP_TABLE_HIGH_BITS, sizeof(uint64_t) * succinct_lookup_table->num_high_bit_words, index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_LOOKUP_TABLE_SELECT_SAMPLES, sizeof(uint64_t) * succinct_lookup_table->num_select_samples, index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_LOOKUP_TABLE_SPARSE_SELECT_POSITIONS, sizeof(uint64_t) * succinct_lookup_table->num_sparse_select_positions, index->mapped_index_size)) {
+      fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    succinct_lookup_table->low_bits = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_LOOKUP_TABLE_LOW_BITS].offset);
+    succinct_lookup_table->high_bits = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_LOOKUP_TABLE_HIGH_BITS].offset);
+    succinct_lookup_table->select_samples = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_LOOKUP_TABLE_SELECT_SAMPLES].offset);
+    succinct_lookup_table->sparse_select_positions = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_LOOKUP_TABLE_SPARSE_SELECT_POSITIONS].offset);
+  } else {
+    if (!check_index_section(header, INDEX_SECTION_LOOKUP_TABLE, sizeof(uint32_t) * lookup_table_size, index->mapped_index_size)) {
+      fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    index->lookup_table = (uint32_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_LOOKUP_TABLE].offset);
+  }
+  uint8_t *occurrence_table = (uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_OCCURRENCE_TABLE].offset;
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_LOCATION) {
+    index->occurrence_table = (uint64_t*)occurrence_table;
+  } else {
+    if (!check_index_section(header, INDEX_SECTION_SEQUENCE_OFFSETS, sizeof(uint64_t) * (index->num_sequences + 1), index->mapped_index_size)) {
+      fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    index->compact_occurrence_table = occurrence_table;
+    index->sequence_offsets = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_SEQUENCE_OFFSETS].offset);
+  }
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+    size_t num_blocks = (index->occurrence_table_size + INDEX_OCCURRENCE_BLOCK_SIZE - 1) / INDEX_OCCURRENCE_BLOCK_SIZE;
+    if (!check_index_section(header, INDEX_SECTION_OCCURRENCE_BLOCK_OFFSETS, sizeof(uint64_t) * (num_blocks + 1), index->mapped_index_size)) {
+      fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    index->occurrence_block_offsets = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_OCCURRENCE_BLOCK_OFFSETS].offset);
+  }
+  if (index->max_bucket_size > 0) {
+    if (!check_index_section(header, INDEX_SECTION_REPEAT_HASH_VALUES, sizeof(uint32_t) * index->num_repeat_buckets, index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_REPEAT_LOOKUP_TABLE, sizeof(uint32_t) * (index->num_repeat_buckets + 1), index->mapped_index_size) || !check_index_section(header, INDEX_SECTION_REPEAT_OCCURRENCE_TABLE, index->keep_repeat_occurrences ? sizeof(uint64_t) * index->repeat_occurrence_table_size : 0, index->mapped_index_size)) {
+      fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+      exit(EXIT_FAILURE);
+    }
+    index->repeat_hash_values = (uint32_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_REPEAT_HASH_VALUES].offset);
+    index->repeat_lookup_table = (uint32_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_REPEAT_LOOKUP_TABLE].offset);
+    if (index->keep_repeat_occurrences) {
+      index->repeat_occurrence_table = (uint64_t*)((uint8_t*)index->mapped_index + header->sections[INDEX_SECTION_REPEAT_OCCURRENCE_TABLE].offset);
+    }
+  }
+  if (header->flags & INDEX_FLAG_REFERENCE_EMBEDDED) {
+    map_embedded_reference(index_file_path, header, index);
+  }
+  if (index->prefault_mode == INDEX_PREFAULT_PARALLEL && index->placed_index_size == 0) {
+    prefault_mapped_index(index);
+  }
+}
+
+typedef struct {
+  const ParallelFile *file;
+  const IndexContainerHeader *container_header;
+  const uint64_t *block_table;
+  uint8_t *index_image;
+  size_t *next_block;
+  int *has_failed;
+} BlockDecompressionArgs;
+
+static void *decompress_blocks_thread(void *block_decompression_args_v) {
+  BlockDecompressionArgs *args = (BlockDecompressionArgs*)block_decompression_args_v;
+  const IndexContainerHeader *container_header = args->container_header;
+  // Each block is read with a single positioned read by this thread.
+  ParallelFile block_file = {args->file->fd, -1, 1};
+  uint8_t *compressed_block = (uint8_t*)malloc(container_header->max_compressed_block_size);
+  assert(compressed_block);
+  while (!*(args->has_failed)) {
+    size_t block_index = __sync_fetch_and_add(args->next_block, 1);
+    if (block_index >= container_header->num_blocks) {
+      break;
+    }
+    // Block 0 is the header page and block i > 0 starts one page later.
+    uint64_t block_start = block_index == 0 ? 0 : INDEX_FILE_ALIGNMENT + (block_index - 1) * container_header->block_size;
+    uint64_t block_end = block_index == 0 ? INDEX_FILE_ALIGNMENT : block_start + container_header->block_size;
+    if (block_end > container_header->index_file_size) {
+      block_end = container_header->index_file_size;
+    }
+    uint64_t compressed_block_size = args->block_table[2 * block_index + 1];
+    uLongf block_size = block_end - block_start;
+    if (compressed_block_size > container_header->max_compressed_block_size || !read_parallel_file(&block_file, compressed_block, compressed_block_size, args->block_table[2 * block_index]) || uncompress(args->index_image + block_start, &block_size, compressed_block, compressed_block_size) != Z_OK || block_size != block_end - block_start) {
+      *(args->has_failed) = 1;
+    }
+  }
+  free(compressed_block);
+  return NULL;
+}
+
+// Decompresses an index saved in the zlib block container into placed memory,
+// one block per thread at a time.
+static void load_index_container(const char *index_file_path, Index *index) {
+  ParallelFile index_file;
+  if (!open_parallel_file_for_reading(index_file_path, index->num_threads, 0, &index_file)) {
+    fprintf(stderr, "Failed to open index file %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  double real_start_time = get_real_time();
+  IndexContainerHeader container_header;
+  if (!read_parallel_file(&index_file, &container_header, sizeof(IndexContainerHeader), 0) || container_header.version != INDEX_CONTAINER_VERSION) {
+    fprintf(stderr, "Unsupported index file version in %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  uint64_t expected_num_blocks = container_header.block_size == 0 || container_header.index_file_size < INDEX_FILE_ALIGNMENT ? 0 : 1 + (container_header.index_file_size - INDEX_FILE_ALIGNMENT + container_header.block_size - 1) / container_header.block_size;
+  if (expected_num_blocks == 0 || container_header.num_blocks != expected_num_blocks) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  uint64_t *block_table = (uint64_t*)malloc(sizeof(uint64_t) * 2 * container_header.num_blocks);
+  assert(block_table);
+  if (!read_parallel_file(&index_file, block_table, sizeof(uint64_t) * 2 * container_header.num_blocks, container_header.block_table_offset)) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  index->mapped_index_size = container_header.index_file_size;
+  index->mapped_index = allocate_placed_memory(index->mapped_index_size, &(index->memory_placement), &(index->placed_index_size));
+  int num_threads = (uint64_t)index_file.num_threads < container_header.num_blocks ? index_file.num_threads : (int)container_header.num_blocks;
+  size_t next_block = 0;
+  int has_failed = 0;
+  BlockDecompressionArgs args = {&index_file, &container_header, block_table, (uint8_t*)index->mapped_index, &next_block, &has_failed};
+  pthread_t decompression_thread_handles[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_create(decompression_thread_handles + i, NULL, decompress_blocks_thread, &args);
+    assert(pthread_err == 0);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_join(decompression_thread_handles[i], NULL);
+    assert(pthread_err == 0);
+  }
+  free(block_table);
+  close_parallel_file(&index_file);
+  if (has_failed) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "Decompressed %.2f MB of index with %d threads in %fs.\n", index->mapped_index_size / 1048576.0, num_threads, get_real_time() - real_start_time);
+  if (((const IndexFileHeader*)index->mapped_index)->magic != INDEX_FILE_MAGIC) {
+    fprintf(stderr, "Index file %s is truncated or corrupted.\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  attach_index_sections(index_file_path, index);
+}
+
+// Loads an index written before the versioned layout was introduced.
+static void load_legacy_index(Index *index) {
+  size_t num_read_elements = fread(&(index->kmer_size), sizeof(int), 1, index->index_file); //TODO: check fread return value
+  if (num_read_elements != 1) {
+    fprintf(stderr, "Load error while initializing hash table.\n");
+    exit(EXIT_FAILURE);
+  }
+  num_read_elements = fread(&(index->step_size), sizeof(int), 1, index->index_file);
   if (num_read_elements != 1) {
     fprintf(stderr, "Load error while initializing hash table.\n");
     exit(EXIT_FAILURE);
@@ -120,49 +1788,674 @@ void load_index(const char *index_file_path, Index *index) {
   //load the hash table
   //load the lookup table
   num_read_elements = fread(index->lookup_table, sizeof(uint32_t), lookup_table_size, index->index_file);
+  if (num_read_elements != lookup_table_size) {
+    fprintf(stderr, "Load error while reading the lookup table.\n");
+    exit(EXIT_FAILURE);
+  }
   //load the occurrence table
   num_read_elements = fread(&(index->occurrence_table_size), sizeof(size_t), 1, index->index_file);
-  assert(num_read_elements == 1);
+  if (num_read_elements != 1) {
+    fprintf(stderr, "Load error while reading the occurrence table.\n");
+    exit(EXIT_FAILURE);
+  }
   index->occurrence_table = (uint64_t*) malloc(sizeof(uint64_t) * index->occurrence_table_size);
   assert(index->occurrence_table);
   num_read_elements = fread(index->occurrence_table, sizeof(uint64_t), index->occurrence_table_size, index->index_file);
+  if (num_read_elements != index->occurrence_table_size) {
+    fprintf(stderr, "Load error while reading the occurrence table.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void load_index(const char *index_file_path, Index *index) {
+  double real_start_time = get_real_time();
+  index->index_file = fopen(index_file_path, "rb");
+  if (index->index_file == NULL) {
+    fprintf(stderr, "Failed to open index file %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  uint64_t magic = 0;
+  size_t num_read_elements = fread(&magic, sizeof(uint64_t), 1, index->index_file);
+  if (num_read_elements == 1 && magic == INDEX_FILE_MAGIC) {
+    fclose(index->index_file);
+    index->index_file = NULL;
+    map_index(index_file_path, index);
+    fprintf(stderr, "Mapped index in %fs!\n", get_real_time() - real_start_time);
+    return;
+  }
+  if (num_read_elements == 1 && magic == INDEX_CONTAINER_MAGIC) {
+    fclose(index->index_file);
+    index->index_file = NULL;
+    load_index_container(index_file_path, index);
+    fprintf(stderr, "Loaded compressed index in %fs!\n", get_real_time() - real_start_time);
+    return;
+  }
+  rewind(index->index_file);
+  load_legacy_index(index);
   fclose(index->index_file);
+  index->index_file = NULL;
   fprintf(stderr, "Loaded index in %fs!\n", get_real_time() - real_start_time);
 }
 
+// Sections are appended at page-aligned offsets with positioned writes, so
+// the chunks of a large section can be written by several threads at once.
+// For the zlib container, the layout is instead gathered into one block per
+// thread, and the blocks are compressed together once they are all full.
+typedef struct {
+  ParallelFile file;
+  uint64_t offset; // end of the last section, padding included
+  int is_compressed;
+  uint8_t *pending_blocks; // the layout from the first block not written yet
+  size_t num_pending_bytes;
+  uint8_t *compressed_blocks; // compressBound(INDEX_CONTAINER_BLOCK_SIZE) bytes per block
+  uLongf *compressed_block_sizes;
+  uint64_t container_offset; // end of the compressed blocks written so far
+  uint64_t max_compressed_block_size;
+  kvec_t_uint64_t block_table; // compressed offset and size of each block
+} IndexFileWriter;
+
+typedef struct {
+  const uint8_t *block;
+  size_t block_size;
+  uint8_t *compressed_block;
+  uLongf *compressed_block_size;
+  int result;
+} BlockCompressionArgs;
+
+static void *compress_block_thread(void *block_compression_args_v) {
+  BlockCompressionArgs *args = (BlockCompressionArgs*)block_compression_args_v;
+  args->result = compress2(args->compressed_block, args->compressed_block_size, args->block, args->block_size, INDEX_CONTAINER_COMPRESSION_LEVEL);
+  return NULL;
+}
+
+static void write_compressed_block(IndexFileWriter *index_file_writer, const uint8_t *compressed_block, uint64_t compressed_block_size, size_t block_index) {
+  if (!write_parallel_file(&(index_file_writer->file), compressed_block, compressed_block_size, index_file_writer->container_offset)) {
+    fprintf(stderr, "Write error while saving index.\n");
+    exit(EXIT_FAILURE);
+  }
+  kv_A(index_file_writer->block_table.v, 2 * block_index) = index_file_writer->container_offset;
+  kv_A(index_file_writer->block_table.v, 2 * block_index + 1) = compressed_block_size;
+  index_file_writer->container_offset += compressed_block_size;
+  if (compressed_block_size > index_file_writer->max_compressed_block_size) {
+    index_file_writer->max_compressed_block_size = compressed_block_size;
+  }
+}
+
+// Compresses the pending blocks with one thread each and appends them in order.
+static void flush_index_file_blocks(IndexFileWriter *index_file_writer) {
+  int num_blocks = (index_file_writer->num_pending_bytes + INDEX_CONTAINER_BLOCK_SIZE - 1) / INDEX_CONTAINER_BLOCK_SIZE;
+  pthread_t compression_thread_handles[num_blocks];
+  BlockCompressionArgs args[num_blocks];
+  size_t compressed_block_capacity = compressBound(INDEX_CONTAINER_BLOCK_SIZE);
+  for (int i = 0; i < num_blocks; ++i) {
+    size_t block_start = (size_t)INDEX_CONTAINER_BLOCK_SIZE * i;
+    args[i].block = index_file_writer->pending_blocks + block_start;
+    args[i].block_size = index_file_writer->num_pending_bytes - block_start < INDEX_CONTAINER_BLOCK_SIZE ? index_file_writer->num_pending_bytes - block_start : INDEX_CONTAINER_BLOCK_SIZE;
+    args[i].compressed_block = index_file_writer->compressed_blocks + compressed_block_capacity * i;
+    args[i].compressed_block_size = index_file_writer->compressed_block_sizes + i;
+    *(args[i].compressed_block_size) = compressed_block_capacity;
+    int pthread_err = pthread_create(compression_thread_handles + i, NULL, compress_block_thread, args + i);
+    assert(pthread_err == 0);
+  }
+  for (int i = 0; i < num_blocks; ++i) {
+    int pthread_err = pthread_join(compression_thread_handles[i], NULL);
+    assert(pthread_err == 0);
+    if (args[i].result != Z_OK) {
+      fprintf(stderr, "Failed to compress the index.\n");
+      exit(EXIT_FAILURE);
+    }
+    kv_push(uint64_t, index_file_writer->block_table.v, 0);
+    kv_push(uint64_t, index_file_writer->block_table.v, 0);
+    write_compressed_block(index_file_writer, args[i].compressed_block, *(args[i].compressed_block_size), kv_size(index_file_writer->block_table.v) / 2 - 1);
+  }
+  index_file_writer->num_pending_bytes = 0;
+}
+
+static void initialize_index_file_writer(const char *index_file_path, const Index *index, IndexFileWriter *index_file_writer) {
+  memset(index_file_writer, 0, sizeof(IndexFileWriter));
+  if (!open_parallel_file_for_writing(index_file_path, index->num_threads, index->direct_io, &(index_file_writer->file))) {
+    fprintf(stderr, "Failed to open index file %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  // The header page is written last, once all the section offsets are known.
+  index_file_writer->offset = INDEX_FILE_ALIGNMENT;
+  index_file_writer->is_compressed = index->compress_index_file;
+  if (index_file_writer->is_compressed) {
+    int num_threads = index_file_writer->file.num_threads;
+    index_file_writer->pending_blocks = (uint8_t*)malloc((size_t)INDEX_CONTAINER_BLOCK_SIZE * num_threads);
+    index_file_writer->compressed_blocks = (uint8_t*)malloc(compressBound(INDEX_CONTAINER_BLOCK_SIZE) * num_threads);
+    index_file_writer->compressed_block_sizes = (uLongf*)malloc(sizeof(uLongf) * num_threads);
+    assert(index_file_writer->pending_blocks && index_file_writer->compressed_blocks && index_file_writer->compressed_block_sizes);
+    kv_init(index_file_writer->block_table.v);
+    // Block 0 is the header page.
+    kv_push(uint64_t, index_file_writer->block_table.v, 0);
+    kv_push(uint64_t, index_file_writer->block_table.v, 0);
+    index_file_writer->container_offset = sizeof(IndexContainerHeader);
+  }
+}
+
+static void write_to_index_file(const void *data, size_t size, IndexFileWriter *index_file_writer) {
+  if (!index_file_writer->is_compressed) {
+    if (!write_parallel_file(&(index_file_writer->file), data, size, index_file_writer->offset)) {
+      fprintf(stderr, "Write error while saving index.\n");
+      exit(EXIT_FAILURE);
+    }
+    index_file_writer->offset += size;
+    return;
+  }
+  size_t max_num_pending_bytes = (size_t)INDEX_CONTAINER_BLOCK_SIZE * index_file_writer->file.num_threads;
+  const uint8_t *bytes = (const uint8_t*)data;
+  while (size > 0) {
+    size_t num_copied_bytes = max_num_pending_bytes - index_file_writer->num_pending_bytes < size ? max_num_pending_bytes - index_file_writer->num_pending_bytes : size;
+    memcpy(index_file_writer->pending_blocks + index_file_writer->num_pending_bytes, bytes, num_copied_bytes);
+    index_file_writer->num_pending_bytes += num_copied_bytes;
+    bytes += num_copied_bytes;
+    size -= num_copied_bytes;
+    index_file_writer->offset += num_copied_bytes;
+    if (index_file_writer->num_pending_bytes == max_num_pending_bytes) {
+      flush_index_file_blocks(index_file_writer);
+    }
+  }
+}
+
+// Writes the header page and, for the container, the remaining blocks, block 0,
+// the block table and the container header, then closes the file.
+static void finalize_index_file_writer(const IndexFileHeader *header, IndexFileWriter *index_file_writer) {
+  if (!index_file_writer->is_compressed) {
+    if (!write_parallel_file(&(index_file_writer->file), header, sizeof(IndexFileHeader), 0) || !close_parallel_file(&(index_file_writer->file))) {
+      fprintf(stderr, "Write error while saving index.\n");
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+  if (index_file_writer->num_pending_bytes > 0) {
+    flush_index_file_blocks(index_file_writer);
+  }
+  uint8_t header_page[INDEX_FILE_ALIGNMENT] = {0};
+  memcpy(header_page, header, sizeof(IndexFileHeader));
+  uLongf compressed_header_page_size = compressBound(INDEX_FILE_ALIGNMENT);
+  if (compress2(index_file_writer->compressed_blocks, &compressed_header_page_size, header_page, INDEX_FILE_ALIGNMENT, INDEX_CONTAINER_COMPRESSION_LEVEL) != Z_OK) {
+    fprintf(stderr, "Failed to compress the index.\n");
+    exit(EXIT_FAILURE);
+  }
+  write_compressed_block(index_file_writer, index_file_writer->compressed_blocks, compressed_header_page_size, 0);
+  IndexContainerHeader container_header;
+  memset(&container_header, 0, sizeof(IndexContainerHeader));
+  container_header.magic = INDEX_CONTAINER_MAGIC;
+  container_header.version = INDEX_CONTAINER_VERSION;
+  container_header.block_size = INDEX_CONTAINER_BLOCK_SIZE;
+  container_header.index_file_size = index_file_writer->offset;
+  container_header.num_blocks = kv_size(index_file_writer->block_table.v) / 2;
+  container_header.block_table_offset = index_file_writer->container_offset;
+  container_header.max_compressed_block_size = index_file_writer->max_compressed_block_size;
+  if (!write_parallel_file(&(index_file_writer->file), index_file_writer->block_table.v.a, sizeof(uint64_t) * kv_size(index_file_writer->block_table.v), index_file_writer->container_offset) || !write_parallel_file(&(index_file_writer->file), &container_header, sizeof(IndexContainerHeader), 0) || !close_parallel_file(&(index_file_writer->file))) {
+    fprintf(stderr, "Write error while saving index.\n");
+    exit(EXIT_FAILURE);
+  }
+  index_file_writer->container_offset += sizeof(uint64_t) * kv_size(index_file_writer->block_table.v);
+  free(index_file_writer->pending_blocks);
+  free(index_file_writer->compressed_blocks);
+  free(index_file_writer->compressed_block_sizes);
+  kv_destroy(index_file_writer->block_table.v);
+}
+
+static void write_index_section(const void *section, size_t section_size, IndexFileWriter *index_file_writer, IndexFileSection *section_in_header) {
+  static const uint8_t padding[INDEX_FILE_ALIGNMENT] = {0};
+  section_in_header->offset = index_file_writer->offset;
+  section_in_header->size = section_size;
+  size_t padding_size = (INDEX_FILE_ALIGNMENT - section_size % INDEX_FILE_ALIGNMENT) % INDEX_FILE_ALIGNMENT;
+  write_to_index_file(section, section_size, index_file_writer);
+  write_to_index_file(padding, padding_size, index_file_writer);
+}
+
+static void initialize_index_file_header(const Index *index, IndexFileHeader *header) {
+  memset(header, 0, sizeof(IndexFileHeader));
+  header->magic = INDEX_FILE_MAGIC;
+  header->version = INDEX_FILE_VERSION;
+  header->kmer_size = index->kmer_size;
+  header->step_size = index->step_size;
+  header->occurrence_table_size = index->occurrence_table_size;
+  header->occurrence_table_encoding = index->occurrence_table_encoding;
+  header->num_sequences = index->num_sequences;
+  header->lookup_table_encoding = index->lookup_table_encoding;
+  header->lookup_table_num_low_bits = index->succinct_lookup_table.num_low_bits;
+  header->compressed_occurrence_table_size = index->compressed_occurrence_table_size;
+  header->max_bucket_size = index->max_bucket_size;
+  header->num_repeat_buckets = index->num_repeat_buckets;
+  header->repeat_occurrence_table_size = index->repeat_occurrence_table_size;
+  header->num_distinct_seeds = index->num_distinct_seeds;
+  header->sparse_prefix_bits = index->sparse_prefix_bits;
+  if (!index->keep_repeat_occurrences) {
+    header->flags |= INDEX_FLAG_REPEAT_OCCURRENCES_DROPPED;
+  }
+  if (index->skip_ambiguous_seeds) {
+    header->flags |= INDEX_FLAG_AMBIGUOUS_SEEDS_SKIPPED;
+  }
+  if (index->canonical_seeds) {
+    header->flags |= INDEX_FLAG_CANONICAL_SEEDS;
+  }
+  if (index->minimizer_seeds) {
+    header->flags |= INDEX_FLAG_MINIMIZER_SEEDS;
+  }
+  if (index->reference.num_sequences > 0) {
+    header->flags |= INDEX_FLAG_REFERENCE_EMBEDDED;
+    header->num_reference_sequences = index->reference.num_sequences;
+    header->num_reference_bases = index->reference.num_bases;
+  }
+}
+
+static void write_embedded_reference(const PackedReference *reference, IndexFileWriter *index_file_writer, IndexFileHeader *header) {
+  if (reference->num_sequences == 0) {
+    return;
+  }
+  IndexFileSection *sections = header->reference_sections;
+  write_index_section(reference->names.v.a, kv_size(reference->names.v), index_file_writer, sections + INDEX_REFERENCE_SECTION_NAMES);
+  write_index_section(reference->sequence_offsets.v.a, sizeof(uint64_t) * (reference->num_sequences + 1), index_file_writer, sections + INDEX_REFERENCE_SECTION_SEQUENCE_OFFSETS);
+  write_index_section(reference->packed_bases.v.a, sizeof(uint64_t) * get_num_packed_base_words(reference->num_bases), index_file_writer, sections + INDEX_REFERENCE_SECTION_PACKED_BASES);
+  write_index_section(reference->ambiguous_bases.v.a, sizeof(uint64_t) * get_num_ambiguous_base_words(reference->num_bases), index_file_writer, sections + INDEX_REFERENCE_SECTION_AMBIGUOUS_BASES);
+}
+
 void save_index(const char *index_file_path, Index *index) {
-  index->index_file = fopen(index_file_path, "wb");
-  size_t num_written_elements = 0;
-  num_written_elements = fwrite(&(index->kmer_size), sizeof(int), 1, index->index_file);
-  num_written_elements = fwrite(&(index->step_size), sizeof(int), 1, index->index_file);
-  if (num_written_elements == 0) {
-    fprintf(stderr, "Write error while initializing hash table.\n");
-    exit(EXIT_FAILURE);
-  }
-  //store the reference
-  //store the length of reference name
-  //store the name of refenrence
-  //initialize_saving_header();
-  //char hd[1000] = "@HD\tVN:1.4\tSO:unsorted\n";
-  //num_written_elements = fwrite(hd, sizeof(char), strlen(hd), header_file);
-  //for (int i = 0; i < reference.refNum; ++i) {
-  //  char* reference_sequence_name = reference.names[i];
-  //  int reference_sequence_length = reference.lookupTable[i + 1] - reference.lookupTable[i];
-  //  int length = sprintf(hd, "@SQ\tSN:%s\tLN:%d\n", reference_sequence_name, reference_sequence_length);
-  //  num_written_elements = fwrite(hd, sizeof(char), length, header_file);
-  //  num_written_elements = fwrite(reference_sequence_name, sizeof(char), REF_NAME_LEN_MAX, index_file);
-  //}
-  //finalize_saving_header();
-  //store the hash table
-  //store the lookup table
-  size_t lookup_table_size = (1 << (2 * index->kmer_size)) + 1;
-  num_written_elements = fwrite(index->lookup_table, sizeof(uint32_t), lookup_table_size, index->index_file);
-  //store the occurrence table
-  num_written_elements = fwrite(&(index->occurrence_table_size), sizeof(size_t), 1, index->index_file);
-  num_written_elements = fwrite(index->occurrence_table, sizeof(uint64_t), index->occurrence_table_size, index->index_file);
-  if (num_written_elements == 0){
-    fprintf(stderr, "Write error while initializing hash table.\n");
+  double real_start_time = get_real_time();
+  IndexFileWriter index_file_writer;
+  initialize_index_file_writer(index_file_path, index, &index_file_writer);
+  IndexFileHeader header;
+  initialize_index_file_header(index, &header);
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    write_index_section(index->sparse_directory, sizeof(uint64_t) * ((((size_t)1) << index->sparse_prefix_bits) + 1), &index_file_writer, &(header.sections[INDEX_SECTION_SPARSE_DIRECTORY]));
+    write_index_section(index->sparse_suffixes, get_sparse_suffix_size(index) * index->num_distinct_seeds, &index_file_writer, &(header.sections[INDEX_SECTION_SPARSE_SUFFIXES]));
+    write_index_section(index->sparse_occurrence_offsets, sizeof(uint64_t) * (index->num_distinct_seeds + 1), &index_file_writer, &(header.sections[INDEX_SECTION_SPARSE_OCCURRENCE_OFFSETS]));
+  } else if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_ELIAS_FANO) {
+    const EliasFanoSequence *succinct_lookup_table = &(index->succinct_lookup_table);
+    write_index_section(succinct_lookup_table->low_bits, sizeof(uint64_t) * succinct_lookup_table->num_low_bit_words, &index_file_writer, &(header.sections[INDEX_SECTION_LOOKUP_TABLE_LOW_BITS]));
+    write_index_section(succinct_lookup_table->high_bits, sizeof(uint64_t) * succinct_lookup_table->num_high_bit_words, &index_file_writer, &(header.sections[INDEX_SECTION_LOOKUP_TABLE_HIGH_BITS]));
+    write_index_section(succinct_lookup_table->select_samples, sizeof(uint64_t) * succinct_lookup_table->num_select_samples, &index_file_writer, &(header.sections[INDEX_SECTION_LOOKUP_TABLE_SELECT_SAMPLES]));
+    write_index_section(succinct_lookup_table->sparse_select_positions, sizeof(uint64_t) * succinct_lookup_table->num_sparse_select_positions, &index_file_writer, &(header.sections[INDEX_SECTION_LOOKUP_TABLE_SPARSE_SELECT_POSITIONS]));
+  } else {
+    size_t lookup_table_size = (1 << (2 * index->kmer_size)) + 1;
+    write_index_section(index->lookup_table, sizeof(uint32_t) * lookup_table_size, &index_file_writer, &(header.sections[INDEX_SECTION_LOOKUP_TABLE]));
+  }
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_LOCATION) {
+    write_index_section(index->occurrence_table, get_occurrence_table_size_in_bytes(index), &index_file_writer, &(header.sections[INDEX_SECTION_OCCURRENCE_TABLE]));
+  } else {
+    write_index_section(index->compact_occurrence_table, get_occurrence_table_size_in_bytes(index), &index_file_writer, &(header.sections[INDEX_SECTION_OCCURRENCE_TABLE]));
+    write_index_section(index->sequence_offsets, sizeof(uint64_t) * (index->num_sequences + 1), &index_file_writer, &(header.sections[INDEX_SECTION_SEQUENCE_OFFSETS]));
+  }
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS) {
+    size_t num_blocks = (index->occurrence_table_size + INDEX_OCCURRENCE_BLOCK_SIZE - 1) / INDEX_OCCURRENCE_BLOCK_SIZE;
+    write_index_section(index->occurrence_block_offsets, sizeof(uint64_t) * (num_blocks + 1), &index_file_writer, &(header.sections[INDEX_SECTION_OCCURRENCE_BLOCK_OFFSETS]));
+  }
+  if (index->max_bucket_size > 0) {
+    write_index_section(index->repeat_hash_values, sizeof(uint32_t) * index->num_repeat_buckets, &index_file_writer, &(header.sections[INDEX_SECTION_REPEAT_HASH_VALUES]));
+    write_index_section(index->repeat_lookup_table, sizeof(uint32_t) * (index->num_repeat_buckets + 1), &index_file_writer, &(header.sections[INDEX_SECTION_REPEAT_LOOKUP_TABLE]));
+    write_index_section(index->repeat_occurrence_table, index->keep_repeat_occurrences ? sizeof(uint64_t) * index->repeat_occurrence_table_size : 0, &index_file_writer, &(header.sections[INDEX_SECTION_REPEAT_OCCURRENCE_TABLE]));
+  }
+  write_embedded_reference(&(index->reference), &index_file_writer, &header);
+  finalize_index_file_writer(&header, &index_file_writer);
+  if (index_file_writer.is_compressed) {
+    fprintf(stderr, "Saved %.2f MB of index as %.2f MB of zlib blocks with %d threads in %fs.\n", index_file_writer.offset / 1048576.0, index_file_writer.container_offset / 1048576.0, index_file_writer.file.num_threads, get_real_time() - real_start_time);
+  } else {
+    fprintf(stderr, "Saved %.2f MB of index with %d threads in %fs.\n", index_file_writer.offset / 1048576.0, index_file_writer.file.num_threads, get_real_time() - real_start_time);
+  }
+}
+
+// A sorted run of seeds spilled to a temporary file by the out-of-core
+// builder, read back through a buffer during the merge. Runs of level 0 are
+// spilled from memory and a run of level l + 1 merges runs of level l.
+typedef struct {
+  FILE *run_file;
+  int level;
+  HashTableEntry *buffer;
+  size_t buffer_size;
+  size_t num_buffered_entries;
+  size_t buffer_position;
+  size_t num_entries_on_disk;
+} SeedRun;
+
+typedef struct {
+  kvec_t(SeedRun) v;
+} kvec_t_SeedRun;
+
+static int compare_hash_table_entry_location(const void *a, const void *b) {
+  uint64_t x = ((const HashTableEntry*)a)->location;
+  uint64_t y = ((const HashTableEntry*)b)->location;
+  return x < y ? -1 : x > y;
+}
+
+static inline int is_hash_table_entry_less(const HashTableEntry *a, const HashTableEntry *b) {
+  return a->hash_value < b->hash_value || (a->hash_value == b->hash_value && a->location < b->location);
+}
+
+// Opens an unlinked temporary file, which goes away when it is closed.
+static FILE *create_seed_run_file(const char *temporary_directory) {
+  char run_file_path[PATH_MAX];
+  snprintf(run_file_path, PATH_MAX, "%s/FEM_index_run_XXXXXX", temporary_directory);
+  int run_file_descriptor = mkstemp(run_file_path);
+  if (run_file_descriptor < 0) {
+    fprintf(stderr, "Failed to create a temporary file in %s: %s\n", temporary_directory, strerror(errno));
     exit(EXIT_FAILURE);
   }
-  fclose(index->index_file);
+  unlink(run_file_path);
+  FILE *run_file = fdopen(run_file_descriptor, "w+b");
+  assert(run_file);
+  return run_file;
+}
+
+static void write_seed_run_entries(const HashTableEntry *entries, size_t num_entries, SeedRun *run) {
+  if (fwrite(entries, sizeof(HashTableEntry), num_entries, run->run_file) != num_entries) {
+    fprintf(stderr, "Write error while spilling seeds to a temporary file.\n");
+    exit(EXIT_FAILURE);
+  }
+  run->num_entries_on_disk += num_entries;
+}
+
+// Sorts the seeds by hash value and then by location and writes them to a
+// new run of level 0.
+static void spill_seed_run(HashTableEntry *entries, size_t num_entries, const char *temporary_directory, kvec_t_SeedRun *runs) {
+  radix_sort_hash_table(entries, entries + num_entries);
+  size_t bucket_start = 0;
+  for (size_t i = 1; i <= num_entries; ++i) {
+    if (i == num_entries || entries[i].hash_value != entries[bucket_start].hash_value) {
+      qsort(entries + bucket_start, i - bucket_start, sizeof(HashTableEntry), compare_hash_table_entry_location);
+      bucket_start = i;
+    }
+  }
+  SeedRun run;
+  memset(&run, 0, sizeof(SeedRun));
+  run.run_file = create_seed_run_file(temporary_directory);
+  write_seed_run_entries(entries, num_entries, &run);
+  rewind(run.run_file);
+  kv_push(SeedRun, runs->v, run);
+  fprintf(stderr, "Spilled run %ld with %ld seeds.\n", kv_size(runs->v), num_entries);
+}
+
+// Returns 0 when the run is exhausted.
+static inline int refill_seed_run(SeedRun *run) {
+  if (run->buffer_position < run->num_buffered_entries) {
+    return 1;
+  }
+  size_t num_entries_to_read = run->num_entries_on_disk < run->buffer_size ? run->num_entries_on_disk : run->buffer_size;
+  if (num_entries_to_read == 0) {
+    return 0;
+  }
+  if (fread(run->buffer, sizeof(HashTableEntry), num_entries_to_read, run->run_file) != num_entries_to_read) {
+    fprintf(stderr, "Read error while merging seed runs.\n");
+    exit(EXIT_FAILURE);
+  }
+  run->num_entries_on_disk -= num_entries_to_read;
+  run->num_buffered_entries = num_entries_to_read;
+  run->buffer_position = 0;
+  return 1;
+}
+
+static inline void sift_down_seed_run_heap(SeedRun **heap, size_t heap_size, size_t i) {
+  SeedRun *run = heap[i];
+  for (size_t child = 2 * i + 1; child < heap_size; child = 2 * i + 1) {
+    if (child + 1 < heap_size && is_hash_table_entry_less(heap[child + 1]->buffer + heap[child + 1]->buffer_position, heap[child]->buffer + heap[child]->buffer_position)) {
+      ++child;
+    }
+    if (!is_hash_table_entry_less(heap[child]->buffer + heap[child]->buffer_position, run->buffer + run->buffer_position)) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = run;
+}
+
+// Gives each run a buffer of buffer_size entries in buffers and puts the
+// runs that are not empty into a heap. Returns the heap size.
+static size_t start_seed_run_merge(SeedRun *runs, size_t num_runs, HashTableEntry *buffers, size_t buffer_size, SeedRun **heap) {
+  size_t heap_size = 0;
+  for (size_t i = 0; i < num_runs; ++i) {
+    runs[i].buffer = buffers + i * buffer_size;
+    runs[i].buffer_size = buffer_size;
+    runs[i].num_buffered_entries = 0;
+    runs[i].buffer_position = 0;
+    if (refill_seed_run(runs + i)) {
+      heap[heap_size++] = runs + i;
+    }
+  }
+  for (size_t i = heap_size; i > 0; --i) {
+    sift_down_seed_run_heap(heap, heap_size, i - 1);
+  }
+  return heap_size;
+}
+
+// Takes the smallest seed of the runs in the heap. Returns 0 when all the
+// runs are exhausted.
+static inline int pop_merged_seed(SeedRun **heap, size_t *heap_size, HashTableEntry *entry) {
+  if (*heap_size == 0) {
+    return 0;
+  }
+  SeedRun *run = heap[0];
+  *entry = run->buffer[run->buffer_position];
+  ++run->buffer_position;
+  if (!refill_seed_run(run)) {
+    heap[0] = heap[--(*heap_size)];
+  }
+  if (*heap_size > 0) {
+    sift_down_seed_run_heap(heap, *heap_size, 0);
+  }
+  return 1;
+}
+
+// Merges the last num_runs runs into one run of the next level. The input
+// buffers and the output buffer share buffers, which holds num_buffer_entries
+// entries.
+static void merge_last_seed_runs(size_t num_runs, HashTableEntry *buffers, size_t num_buffer_entries, const char *temporary_directory, kvec_t_SeedRun *runs) {
+  assert(num_runs >= 2 && num_runs <= INDEX_MAX_SEED_RUN_FAN_IN && num_runs <= kv_size(runs->v));
+  SeedRun merged_runs[INDEX_MAX_SEED_RUN_FAN_IN];
+  SeedRun *heap[INDEX_MAX_SEED_RUN_FAN_IN];
+  kv_size(runs->v) -= num_runs;
+  memcpy(merged_runs, runs->v.a + kv_size(runs->v), sizeof(SeedRun) * num_runs);
+  size_t buffer_size = num_buffer_entries / (num_runs + 1);
+  size_t heap_size = start_seed_run_merge(merged_runs, num_runs, buffers, buffer_size, heap);
+  HashTableEntry *output_buffer = buffers + num_runs * buffer_size;
+  SeedRun run;
+  memset(&run, 0, sizeof(SeedRun));
+  run.run_file = create_seed_run_file(temporary_directory);
+  run.level = merged_runs[0].level + 1;
+  size_t num_output_entries = 0;
+  while (pop_merged_seed(heap, &heap_size, output_buffer + num_output_entries)) {
+    if (++num_output_entries == buffer_size) {
+      write_seed_run_entries(output_buffer, num_output_entries, &run);
+      num_output_entries = 0;
+    }
+  }
+  write_seed_run_entries(output_buffer, num_output_entries, &run);
+  rewind(run.run_file);
+  for (size_t i = 0; i < num_runs; ++i) {
+    fclose(merged_runs[i].run_file);
+  }
+  kv_push(SeedRun, runs->v, run);
+  fprintf(stderr, "Merged %ld runs into a run of level %d with %ld seeds.\n", num_runs, run.level, run.num_entries_on_disk);
+}
+
+// Streams one section of the index file in aligned chunks, so that they can
+// go through O_DIRECT. Only the last chunk of the section may be partial.
+typedef struct {
+  const ParallelFile *file;
+  uint64_t offset; // of the next chunk in the file
+  uint8_t *buffer; // INDEX_SECTION_STREAM_BUFFER_SIZE bytes
+  size_t num_buffered_bytes;
+} IndexSectionStream;
+
+static void initialize_index_section_stream(const ParallelFile *file, uint64_t section_offset, IndexSectionStream *stream) {
+  stream->file = file;
+  stream->offset = section_offset;
+  stream->num_buffered_bytes = 0;
+  if (posix_memalign((void**)&(stream->buffer), PARALLEL_IO_DIRECT_ALIGNMENT, INDEX_SECTION_STREAM_BUFFER_SIZE) != 0) {
+    fprintf(stderr, "Failed to allocate an aligned I/O buffer.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void flush_index_section_stream(IndexSectionStream *stream) {
+  if (!write_parallel_file(stream->file, stream->buffer, stream->num_buffered_bytes, stream->offset)) {
+    fprintf(stderr, "Write error while saving index.\n");
+    exit(EXIT_FAILURE);
+  }
+  stream->offset += stream->num_buffered_bytes;
+  stream->num_buffered_bytes = 0;
+}
+
+static inline void write_to_index_section_stream(const void *element, size_t element_size, IndexSectionStream *stream) {
+  if (stream->num_buffered_bytes + element_size > INDEX_SECTION_STREAM_BUFFER_SIZE) {
+    flush_index_section_stream(stream);
+  }
+  memcpy(stream->buffer + stream->num_buffered_bytes, element, element_size);
+  stream->num_buffered_bytes += element_size;
+}
+
+static void destroy_index_section_stream(IndexSectionStream *stream) {
+  flush_index_section_stream(stream);
+  free(stream->buffer);
+  stream->buffer = NULL;
+}
+
+// Builds the default index of a reference that does not fit in memory and
+// writes it to index_file_path. Seeds are collected one reference sequence at
+// a time into a buffer of max_memory bytes, which is sorted and spilled to
+// temporary_directory whenever it fills up. The runs are then merged straight
+// into the lookup table and occurrence table sections of the index file.
+void construct_index_out_of_core(const char *reference_file_path, const char *index_file_path, size_t max_memory, const char *temporary_directory, Index *index) {
+  double real_start_time = get_real_time();
+  size_t max_num_run_entries = max_memory / sizeof(HashTableEntry);
+  if (max_num_run_entries < 3 * INDEX_MIN_SEED_RUN_BUFFER_SIZE) {
+    fprintf(stderr, "The memory for out-of-core index construction is too small.\n");
+    exit(EXIT_FAILURE);
+  }
+  // Each merged run and the output of a merge get a buffer of at least
+  // INDEX_MIN_SEED_RUN_BUFFER_SIZE entries.
+  size_t fan_in = max_num_run_entries / INDEX_MIN_SEED_RUN_BUFFER_SIZE - 1;
+  if (fan_in > INDEX_MAX_SEED_RUN_FAN_IN) {
+    fan_in = INDEX_MAX_SEED_RUN_FAN_IN;
+  }
+  HashTableEntry *run_entries = (HashTableEntry*)malloc(sizeof(HashTableEntry) * max_num_run_entries);
+  assert(run_entries);
+  kvec_t_SeedRun runs;
+  kv_init(runs.v);
+  SequenceBatch reference_sequence_batch;
+  initialize_sequence_batch_with_max_size(1, &reference_sequence_batch);
+  initialize_sequence_batch_loading(reference_file_path, &reference_sequence_batch);
+  kvec_t_uint32_t minimizer_positions;
+  kv_init(minimizer_positions.v);
+  size_t num_run_entries = 0;
+  size_t num_seeds = 0;
+  uint32_t sequence_index = 0;
+  load_batch_of_sequences_into_sequence_batch(&reference_sequence_batch);
+  while (reference_sequence_batch.num_loaded_sequences > 0) {
+    uint32_t sequence_length = get_sequence_length_from_sequence_batch_at(&reference_sequence_batch, 0);
+    const char *sequence = get_sequence_from_sequence_batch_at(&reference_sequence_batch, 0);
+    kv_clear(minimizer_positions.v);
+    if (index->minimizer_seeds) {
+      collect_minimizer_positions(index, sequence, sequence_length, &minimizer_positions);
+    }
+    size_t num_sequence_seeds = get_num_sampled_seeds(index, sequence_length, kv_size(minimizer_positions.v));
+    for (size_t seed_index = 0; seed_index < num_sequence_seeds; ++seed_index) {
+      uint32_t sequence_position = get_sampled_seed_position(index, &minimizer_positions, 0, seed_index);
+      if (index->skip_ambiguous_seeds && seed_has_ambiguous_base(sequence_position, index->kmer_size, sequence)) {
+        continue;
+      }
+      if (num_run_entries == max_num_run_entries) {
+        spill_seed_run(run_entries, num_run_entries, temporary_directory, &runs);
+        num_run_entries = 0;
+        // Like the carries of a counter in base fan_in, fan_in runs of a
+        // level make one of the next, so that few run files are open at once.
+        // The run buffer is free until the next seed.
+        while (kv_size(runs.v) >= fan_in && kv_A(runs.v, kv_size(runs.v) - fan_in).level == kv_A(runs.v, kv_size(runs.v) - 1).level) {
+          merge_last_seed_runs(fan_in, run_entries, max_num_run_entries, temporary_directory, &runs);
+        }
+      }
+      uint64_t hash_value = hash_seed_in_sequence(sequence_position, index->kmer_size, sequence, sequence_length);
+      run_entries[num_run_entries].location = get_indexed_seed_location(index, sequence_index, sequence_position, &hash_value);
+      run_entries[num_run_entries].hash_value = hash_value;
+      ++num_run_entries;
+      ++num_seeds;
+    }
+    if (index->embed_reference) {
+      append_sequence_to_packed_reference(get_sequence_name_from_sequence_batch_at(&reference_sequence_batch, 0), sequence, sequence_length, &(index->reference));
+    }
+    ++sequence_index;
+    load_batch_of_sequences_into_sequence_batch(&reference_sequence_batch);
+  }
+  if (num_run_entries > 0) {
+    spill_seed_run(run_entries, num_run_entries, temporary_directory, &runs);
+  }
+  kv_destroy(minimizer_positions.v);
+  finalize_sequence_batch_loading(&reference_sequence_batch);
+  destory_sequence_batch(&reference_sequence_batch);
+  if (num_seeds > UINT32_MAX) {
+    fprintf(stderr, "Too many seeds for the lookup table, please use a larger step size.\n");
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "Collected %ld seeds in %ld runs in %fs.\n", num_seeds, kv_size(runs.v), get_real_time() - real_start_time);
+
+  // The merge buffers share the memory of the run buffer. At most fan_in runs
+  // are left for the last merge, which writes the index.
+  while (kv_size(runs.v) > fan_in) {
+    merge_last_seed_runs(fan_in, run_entries, max_num_run_entries, temporary_directory, &runs);
+  }
+  size_t num_runs = kv_size(runs.v);
+  SeedRun *heap[INDEX_MAX_SEED_RUN_FAN_IN];
+  size_t heap_size = num_runs == 0 ? 0 : start_seed_run_merge(runs.v.a, num_runs, run_entries, max_num_run_entries / num_runs, heap);
+
+  index->occurrence_table_size = num_seeds;
+  index->occurrence_table_encoding = INDEX_OCCURRENCE_TABLE_LOCATION;
+  index->lookup_table_encoding = INDEX_LOOKUP_TABLE_DENSE;
+  size_t lookup_table_size = (((size_t)1) << (2 * index->kmer_size)) + 1;
+  IndexFileHeader header;
+  initialize_index_file_header(index, &header);
+  header.sections[INDEX_SECTION_LOOKUP_TABLE].offset = INDEX_FILE_ALIGNMENT;
+  header.sections[INDEX_SECTION_LOOKUP_TABLE].size = sizeof(uint32_t) * lookup_table_size;
+  header.sections[INDEX_SECTION_OCCURRENCE_TABLE].offset = (INDEX_FILE_ALIGNMENT + sizeof(uint32_t) * lookup_table_size + INDEX_FILE_ALIGNMENT - 1) / INDEX_FILE_ALIGNMENT * INDEX_FILE_ALIGNMENT;
+  header.sections[INDEX_SECTION_OCCURRENCE_TABLE].size = sizeof(uint64_t) * num_seeds;
+  size_t index_file_size = (header.sections[INDEX_SECTION_OCCURRENCE_TABLE].offset + header.sections[INDEX_SECTION_OCCURRENCE_TABLE].size + INDEX_FILE_ALIGNMENT - 1) / INDEX_FILE_ALIGNMENT * INDEX_FILE_ALIGNMENT;
+  // Both sections are written sequentially, each through its own stream.
+  // The chunks are aligned and so go through O_DIRECT with --direct-io.
+  ParallelFile index_file;
+  if (!open_parallel_file_for_writing(index_file_path, index->num_threads, index->direct_io, &index_file)) {
+    fprintf(stderr, "Failed to open index file %s\n", index_file_path);
+    exit(EXIT_FAILURE);
+  }
+  if (ftruncate(index_file.fd, index_file_size) != 0) {
+    fprintf(stderr, "Write error while saving index.\n");
+    exit(EXIT_FAILURE);
+  }
+  IndexSectionStream lookup_table_stream;
+  IndexSectionStream occurrence_table_stream;
+  initialize_index_section_stream(&index_file, header.sections[INDEX_SECTION_LOOKUP_TABLE].offset, &lookup_table_stream);
+  initialize_index_section_stream(&index_file, header.sections[INDEX_SECTION_OCCURRENCE_TABLE].offset, &occurrence_table_stream);
+  size_t num_written_lookup_table_entries = 0;
+  uint32_t num_merged_seeds = 0;
+  HashTableEntry entry;
+  while (pop_merged_seed(heap, &heap_size, &entry)) {
+    for (; num_written_lookup_table_entries <= entry.hash_value; ++num_written_lookup_table_entries) {
+      write_to_index_section_stream(&num_merged_seeds, sizeof(uint32_t), &lookup_table_stream);
+    }
+    write_to_index_section_stream(&(entry.location), sizeof(uint64_t), &occurrence_table_stream);
+    ++num_merged_seeds;
+  }
+  for (; num_written_lookup_table_entries < lookup_table_size; ++num_written_lookup_table_entries) {
+    write_to_index_section_stream(&num_merged_seeds, sizeof(uint32_t), &lookup_table_stream);
+  }
+  assert(num_merged_seeds == num_seeds);
+  destroy_index_section_stream(&lookup_table_stream);
+  destroy_index_section_stream(&occurrence_table_stream);
+  // The reference goes after the two tables, which the header already describes.
+  IndexFileWriter index_file_writer;
+  memset(&index_file_writer, 0, sizeof(IndexFileWriter));
+  index_file_writer.file = index_file;
+  index_file_writer.offset = index_file_size;
+  if (index->embed_reference) {
+    write_embedded_reference(&(index->reference), &index_file_writer, &header);
+  }
+  finalize_index_file_writer(&header, &index_file_writer);
+  for (size_t i = 0; i < num_runs; ++i) {
+    fclose(kv_A(runs.v, i).run_file);
+  }
+  kv_destroy(runs.v);
+  free(run_entries);
+  fprintf(stderr, "Built and saved index out of core in %fs.\n", get_real_time() - real_start_time);
 }
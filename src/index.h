@@ -1,30 +1,430 @@
 #ifndef INDEX_H_
 #define INDEX_H_
 
+#include "memory_placement.h"
+#include "packed_reference.h"
+#include "parallel_io.h"
 #include "sequence_batch.h"
 #include "utils.h"
 
+// On-disk layout: a header in the first page followed by sections that each
+// start on a page boundary, so that the whole file can be mmapped and the
+// tables used in place.
+#define INDEX_FILE_MAGIC 0x5845444e494d4546ULL // "FEMINDEX"
+#define INDEX_FILE_VERSION 1
+#define INDEX_FILE_ALIGNMENT 4096
+#define INDEX_MAX_NUM_SECTIONS 16
+
+#define INDEX_SECTION_LOOKUP_TABLE 0
+#define INDEX_SECTION_OCCURRENCE_TABLE 1
+#define INDEX_SECTION_SEQUENCE_OFFSETS 2
+#define INDEX_SECTION_LOOKUP_TABLE_LOW_BITS 3
+#define INDEX_SECTION_LOOKUP_TABLE_HIGH_BITS 4
+#define INDEX_SECTION_LOOKUP_TABLE_SELECT_SAMPLES 5
+#define INDEX_SECTION_LOOKUP_TABLE_SPARSE_SELECT_POSITIONS 6
+#define INDEX_SECTION_OCCURRENCE_BLOCK_OFFSETS 7
+#define INDEX_SECTION_REPEAT_HASH_VALUES 8
+#define INDEX_SECTION_REPEAT_LOOKUP_TABLE 9
+#define INDEX_SECTION_REPEAT_OCCURRENCE_TABLE 10
+#define INDEX_SECTION_SPARSE_DIRECTORY 11
+#define INDEX_SECTION_SPARSE_SUFFIXES 12
+#define INDEX_SECTION_SPARSE_OCCURRENCE_OFFSETS 13
+
+// Sections of the embedded reference, which has its own table in the header.
+#define INDEX_REFERENCE_SECTION_NAMES 0
+#define INDEX_REFERENCE_SECTION_SEQUENCE_OFFSETS 1
+#define INDEX_REFERENCE_SECTION_PACKED_BASES 2
+#define INDEX_REFERENCE_SECTION_AMBIGUOUS_BASES 3
+#define INDEX_NUM_REFERENCE_SECTIONS 4
+
+#define INDEX_FLAG_REPEAT_OCCURRENCES_DROPPED 1 // the repeat table keeps frequencies only
+#define INDEX_FLAG_AMBIGUOUS_SEEDS_SKIPPED 2 // no seed overlapping an N is indexed
+#define INDEX_FLAG_REFERENCE_EMBEDDED 4 // the file holds the packed reference, so FEM map needs no FASTA
+#define INDEX_FLAG_CANONICAL_SEEDS 8 // seeds are filed under their canonical k-mers
+#define INDEX_FLAG_MINIMIZER_SEEDS 16 // seeds are (w,k)-minimizers with w in step_size
+// A file with any other flag set, or with an encoding this reader does not
+// know, is rejected rather than misread.
+#define INDEX_KNOWN_FLAGS (INDEX_FLAG_REPEAT_OCCURRENCES_DROPPED | INDEX_FLAG_AMBIGUOUS_SEEDS_SKIPPED | INDEX_FLAG_REFERENCE_EMBEDDED | INDEX_FLAG_CANONICAL_SEEDS | INDEX_FLAG_MINIMIZER_SEEDS)
+
+#define INDEX_PREFAULT_NONE 0 // pages are faulted in lazily by the mapping threads
+#define INDEX_PREFAULT_POPULATE 1 // MAP_POPULATE
+#define INDEX_PREFAULT_PARALLEL 2 // touch the pages with num_threads threads
+#define INDEX_PREFAULT_READ 3 // pread the file into private memory with num_threads threads
+
+#define INDEX_CONSTRUCTION_BY_SORTING 0 // sort (hash value, location) pairs
+#define INDEX_CONSTRUCTION_BY_COUNTING 1 // count k-mers, then scatter locations; peak memory is the final index
+
+// Encodings of the entries in the occurrence table. The compact encodings
+// store offsets into the concatenated reference, which are mapped back to
+// (sequence index, position) with the sequence offsets when a bucket is read.
+#define INDEX_OCCURRENCE_TABLE_LOCATION 0 // uint64_t sequence_index << 32 | position
+#define INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32 1 // uint32_t, for references up to 4 Gbp
+#define INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_40 2 // packed 5-byte little-endian offsets
+#define INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS 3 // StreamVByte blocks of offset deltas, for references up to 4 Gbp
+
+// A canonical index files each seed under the smaller of its code and its
+// reverse complement's, so one bucket serves a read and its reverse
+// complement. Locations where the reference holds the reverse complement of
+// the bucket's k-mer have this bit set, which sorts them after the others.
+#define INDEX_OCCURRENCE_REVERSE_STRAND (((uint64_t)1) << 63)
+
+// Each block of the delta-coded occurrence table holds INDEX_OCCURRENCE_BLOCK_SIZE
+// consecutive entries of the table as 2-bit length codes, one per entry, followed
+// by 1 to 4 bytes per entry. The first entry of a bucket is stored as is and the
+// others as the difference to the previous entry.
+#define INDEX_OCCURRENCE_BLOCK_SIZE 128
+#define INDEX_OCCURRENCE_BLOCK_PADDING 16 // so that the decoder can always load 16 bytes
+
+// How FEM map handles a seed group whose optimal seeds include a repeat, i.e.
+// a seed whose bucket was moved to the repeat table.
+#define REPEAT_POLICY_FULL 0 // use the locations in the repeat table
+#define REPEAT_POLICY_SKIP 1 // generate no candidates from the seed group
+
+// Encodings of the lookup table, i.e. the start of each bucket in the
+// occurrence table.
+#define INDEX_LOOKUP_TABLE_DENSE 0 // uint32_t per hash value
+#define INDEX_LOOKUP_TABLE_ELIAS_FANO 1 // Elias-Fano coded bucket starts, about 2 + log2(seeds / hash values) bits per hash value
+#define INDEX_LOOKUP_TABLE_SPARSE 2 // only the k-mers in the reference, for k up to INDEX_MAX_SPARSE_KMER_SIZE
+
+#define INDEX_MAX_DENSE_KMER_SIZE 15
+#define INDEX_MAX_SPARSE_KMER_SIZE 32
+// The sparse lookup table is a directory over the top bits of the k-mer codes
+// that points into the sorted remaining bits (suffixes) of the distinct
+// k-mers. The directory gets about one entry per distinct k-mer.
+#define INDEX_MIN_SPARSE_PREFIX_BITS 8
+#define INDEX_MAX_SPARSE_PREFIX_BITS 28
+
+// The out-of-core builder merges at most INDEX_MAX_SEED_RUN_FAN_IN runs at
+// once, each read through a buffer of at least INDEX_MIN_SEED_RUN_BUFFER_SIZE
+// seeds, so it keeps few temporary files open for any number of runs.
+#define INDEX_MAX_SEED_RUN_FAN_IN 16
+#define INDEX_MIN_SEED_RUN_BUFFER_SIZE 64
+// The out-of-core builder writes each table section in chunks of this size.
+#define INDEX_SECTION_STREAM_BUFFER_SIZE (1024 * 1024)
+
+// One select sample is kept every ELIAS_FANO_SELECT_SAMPLE_RATE ones of the
+// high bits. Sample blocks that span at least ELIAS_FANO_SPARSE_BLOCK_SPAN bits
+// store the positions of all their ones instead, so that a select never scans
+// more than ELIAS_FANO_SPARSE_BLOCK_SPAN bits.
+#define ELIAS_FANO_SELECT_SAMPLE_RATE_SHIFT 8
+#define ELIAS_FANO_SELECT_SAMPLE_RATE (1 << ELIAS_FANO_SELECT_SAMPLE_RATE_SHIFT)
+#define ELIAS_FANO_SPARSE_BLOCK_SPAN (1 << 14)
+#define ELIAS_FANO_SPARSE_SAMPLE_FLAG (((uint64_t)1) << 63)
+
+typedef struct {
+  uint64_t offset;
+  uint64_t size; // in bytes
+} IndexFileSection;
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t flags;
+  int32_t kmer_size;
+  int32_t step_size;
+  uint64_t occurrence_table_size;
+  IndexFileSection sections[INDEX_MAX_NUM_SECTIONS];
+  uint32_t occurrence_table_encoding;
+  uint32_t num_sequences;
+  uint32_t lookup_table_encoding;
+  uint32_t lookup_table_num_low_bits;
+  uint64_t compressed_occurrence_table_size;
+  uint32_t max_bucket_size;
+  uint32_t num_repeat_buckets;
+  uint64_t repeat_occurrence_table_size;
+  uint64_t num_distinct_seeds;
+  uint32_t sparse_prefix_bits;
+  uint32_t num_reference_sequences;
+  uint64_t num_reference_bases;
+  IndexFileSection reference_sections[INDEX_NUM_REFERENCE_SECTIONS];
+} IndexFileHeader;
+
+// Optional compressed container around the whole index file. The header page
+// is block 0 and the rest of the file is cut into blocks of
+// INDEX_CONTAINER_BLOCK_SIZE bytes, each compressed on its own with zlib so
+// that they can be written and read back by several threads. The block table
+// at block_table_offset holds the compressed offset and size of every block.
+#define INDEX_CONTAINER_MAGIC 0x5a58444e494d4546ULL // "FEMINDXZ"
+#define INDEX_CONTAINER_VERSION 1
+#define INDEX_CONTAINER_BLOCK_SIZE (4 * 1024 * 1024)
+#define INDEX_CONTAINER_COMPRESSION_LEVEL 1
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t block_size;
+  uint64_t index_file_size; // once decompressed
+  uint64_t num_blocks;
+  uint64_t block_table_offset;
+  uint64_t max_compressed_block_size;
+} IndexContainerHeader;
+
+// A non-decreasing sequence of num_values integers in [0, universe]. Value i
+// is split into num_low_bits low bits, stored verbatim, and the remaining high
+// bits, stored in unary as a one at position (value >> num_low_bits) + i.
+typedef struct {
+  uint64_t num_values;
+  uint64_t universe;
+  int num_low_bits;
+  uint64_t *low_bits;
+  size_t num_low_bit_words;
+  uint64_t *high_bits;
+  size_t num_high_bit_words;
+  uint64_t *select_samples; // position of every ELIAS_FANO_SELECT_SAMPLE_RATE-th one, or ELIAS_FANO_SPARSE_SAMPLE_FLAG | index into sparse_select_positions
+  size_t num_select_samples;
+  uint64_t *sparse_select_positions;
+  size_t num_sparse_select_positions;
+} EliasFanoSequence;
+
 typedef struct {
   int kmer_size;
   int step_size;
   FILE *index_file;
   uint32_t *lookup_table;
+  int lookup_table_encoding; // set to INDEX_LOOKUP_TABLE_ELIAS_FANO before construction to build a succinct lookup table
+  EliasFanoSequence succinct_lookup_table;
+  int sparse_prefix_bits;
+  uint64_t *sparse_directory; // (1 << sparse_prefix_bits) + 1 entries, index of the first distinct k-mer with each prefix
+  size_t num_distinct_seeds;
+  void *sparse_suffixes; // uint32_t, or uint64_t if the suffixes are wider than 32 bits
+  uint64_t *sparse_occurrence_offsets; // num_distinct_seeds + 1 entries
   size_t occurrence_table_size;
   uint64_t *occurrence_table;
+  int occurrence_table_encoding; // set to INDEX_OCCURRENCE_TABLE_GLOBAL_OFFSET_32 or INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS before construction to build a compact table
+  uint8_t *compact_occurrence_table;
+  size_t compressed_occurrence_table_size; // in bytes, for INDEX_OCCURRENCE_TABLE_DELTA_BLOCKS
+  uint64_t *occurrence_block_offsets; // byte offset of each block in compact_occurrence_table
+  uint32_t num_sequences;
+  uint64_t *sequence_offsets; // offset of each sequence in the concatenated reference, num_sequences + 1 entries
+  // Buckets larger than max_bucket_size, if it is not 0, are moved out of the
+  // tables above into the repeat table, which is searched by hash value.
+  uint32_t max_bucket_size;
+  int keep_repeat_occurrences;
+  uint32_t num_repeat_buckets;
+  uint32_t *repeat_hash_values; // sorted
+  uint32_t *repeat_lookup_table; // num_repeat_buckets + 1 entries
+  size_t repeat_occurrence_table_size;
+  uint64_t *repeat_occurrence_table; // sequence_index << 32 | position, NULL when dropped
+  int prefault_mode;
+  MemoryPlacement memory_placement; // when not the default, FEM map reads the index file into placed memory instead of mapping it
+  int num_threads; // also the number of threads that read and write the index file
+  int direct_io; // read and write the index file with O_DIRECT where the ranges are aligned
+  int compress_index_file; // save the index file in the zlib block container
+  int construction_method;
+  int skip_ambiguous_seeds; // leave out the seeds that overlap an ambiguous base instead of reading it as A
+  int embed_reference; // pack the reference into the index file when building it
+  int canonical_seeds; // set before construction to build a canonical index, plain locations only
+  // Set before construction to index the (w,k)-minimizers of the reference,
+  // with the window size w in step_size, instead of every step_size-th seed.
+  int minimizer_seeds;
+  PackedReference reference; // embedded reference, with no sequences if there is none
+  void *mapped_index; // non-NULL when the tables point into a read-only mapping of the index file
+  size_t mapped_index_size;
+  size_t placed_index_size; // non-zero when mapped_index is a copy in placed memory
 } Index;
 
+// Predicted memory of an index and the reference it is used with, in bytes.
+typedef struct {
+  size_t num_seeds;
+  size_t lookup_table_size;
+  size_t occurrence_table_size;
+  size_t sequence_offsets_size;
+  size_t embedded_reference_size;
+  size_t reference_size;
+  size_t total_size;
+} IndexMemoryEstimate;
+
 void initialize_index(Index *index);
 void destroy_index(Index *index);
 void construct_index(const SequenceBatch *sequence_batch, Index *index);
 void load_index(const char *index_file_path, Index *index);
 void save_index(const char *index_file_path, Index *index); 
+// Merges two indexes with embedded references and the same window and step
+// sizes and seed sampling into an initialized index over the sequences of first_index followed
+// by those of second_index. Only dense tables of plain locations without a
+// repeat table can be merged.
+void merge_indexes(const Index *first_index, const Index *second_index, Index *merged_index);
+void construct_index_out_of_core(const char *reference_file_path, const char *index_file_path, size_t max_memory, const char *temporary_directory, Index *index);
+size_t get_occurrence_table_size_in_bytes(const Index *index);
+size_t get_lookup_table_size_in_bytes(const Index *index);
+void estimate_index_memory(const SequenceBatch *sequence_batch, const Index *index, IndexMemoryEstimate *estimate);
+void print_index_memory_estimate(const IndexMemoryEstimate *estimate);
+// Prints a report on the buckets and memory of a loaded index to stdout.
+void print_index_statistics(const Index *index, int num_largest_buckets, int read_length, int error_threshold, int num_additional_qgrams);
+const uint64_t *decode_seed_occurrences(const Index *index, uint64_t hash_value, kvec_t_uint64_t *occurrence_buffer);
+
+// Returns the position of the one with the given rank in the high bits.
+static inline uint64_t select_in_elias_fano_high_bits(const EliasFanoSequence *sequence, uint64_t rank) {
+  uint64_t sample = sequence->select_samples[rank >> ELIAS_FANO_SELECT_SAMPLE_RATE_SHIFT];
+  uint64_t rank_in_block = rank & (ELIAS_FANO_SELECT_SAMPLE_RATE - 1);
+  if (sample & ELIAS_FANO_SPARSE_SAMPLE_FLAG) {
+    return sequence->sparse_select_positions[(sample & ~ELIAS_FANO_SPARSE_SAMPLE_FLAG) + rank_in_block];
+  }
+  size_t word_index = sample >> 6;
+  uint64_t word = sequence->high_bits[word_index] & (~((uint64_t)0) << (sample & 63));
+  int num_ones = __builtin_popcountll(word);
+  while ((uint64_t)num_ones <= rank_in_block) {
+    rank_in_block -= num_ones;
+    word = sequence->high_bits[++word_index];
+    num_ones = __builtin_popcountll(word);
+  }
+  for (; rank_in_block > 0; --rank_in_block) {
+    word &= word - 1;
+  }
+  return (word_index << 6) + __builtin_ctzll(word);
+}
+
+// Returns the position of the first one after the given position in the high bits.
+static inline uint64_t get_next_one_in_elias_fano_high_bits(const EliasFanoSequence *sequence, uint64_t position) {
+  ++position;
+  size_t word_index = position >> 6;
+  uint64_t word = sequence->high_bits[word_index] & (~((uint64_t)0) << (position & 63));
+  while (word == 0) {
+    word = sequence->high_bits[++word_index];
+  }
+  return (word_index << 6) + __builtin_ctzll(word);
+}
+
+static inline uint64_t get_elias_fano_low_bits(const EliasFanoSequence *sequence, uint64_t value_index) {
+  if (sequence->num_low_bits == 0) {
+    return 0;
+  }
+  uint64_t bit_index = value_index * sequence->num_low_bits;
+  uint64_t bit_offset = bit_index & 63;
+  uint64_t low_bits = sequence->low_bits[bit_index >> 6] >> bit_offset;
+  if (bit_offset + sequence->num_low_bits > 64) {
+    low_bits |= sequence->low_bits[(bit_index >> 6) + 1] << (64 - bit_offset);
+  }
+  return low_bits & ((((uint64_t)1) << sequence->num_low_bits) - 1);
+}
+
+// Returns values value_index and value_index + 1 with a single select.
+static inline void get_elias_fano_value_pair(const EliasFanoSequence *sequence, uint64_t value_index, uint64_t *value, uint64_t *next_value) {
+  uint64_t position = select_in_elias_fano_high_bits(sequence, value_index);
+  uint64_t next_position = get_next_one_in_elias_fano_high_bits(sequence, position);
+  *value = ((position - value_index) << sequence->num_low_bits) | get_elias_fano_low_bits(sequence, value_index);
+  *next_value = ((next_position - value_index - 1) << sequence->num_low_bits) | get_elias_fano_low_bits(sequence, value_index + 1);
+}
+
+// Returns the index of the bucket of a seed in the repeat table, or num_repeat_buckets if it is not a repeat.
+static inline uint32_t find_repeat_bucket(const Index *index, uint32_t hash_value) {
+  uint32_t low = 0;
+  uint32_t high = index->num_repeat_buckets;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (index->repeat_hash_values[middle] < hash_value) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < index->num_repeat_buckets && index->repeat_hash_values[low] == hash_value ? low : index->num_repeat_buckets;
+}
+
+// Repeats are exactly the seeds more frequent than max_bucket_size.
+static inline int is_repeat_seed_frequency(const Index *index, uint32_t seed_frequency) {
+  return index->max_bucket_size > 0 && seed_frequency > index->max_bucket_size;
+}
+
+static inline int get_sparse_suffix_bits(const Index *index) {
+  return 2 * index->kmer_size - index->sparse_prefix_bits;
+}
+
+// Returns the index of a k-mer among the distinct k-mers of a sparse index, or num_distinct_seeds if it does not occur.
+static inline size_t find_sparse_seed(const Index *index, uint64_t hash_value) {
+  int suffix_bits = get_sparse_suffix_bits(index);
+  uint64_t prefix = suffix_bits >= 64 ? 0 : hash_value >> suffix_bits;
+  uint64_t suffix = hash_value & (suffix_bits >= 64 ? ~((uint64_t)0) : (((uint64_t)1) << suffix_bits) - 1);
+  size_t low = index->sparse_directory[prefix];
+  size_t high = index->sparse_directory[prefix + 1];
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    uint64_t middle_suffix = suffix_bits > 32 ? ((const uint64_t*)index->sparse_suffixes)[middle] : ((const uint32_t*)index->sparse_suffixes)[middle];
+    if (middle_suffix < suffix) {
+      low = middle + 1;
+    } else if (middle_suffix > suffix) {
+      high = middle;
+    } else {
+      return middle;
+    }
+  }
+  return index->num_distinct_seeds;
+}
+
+// Returns the bucket of a seed as [occurrence_start, occurrence_end) in the occurrence table.
+static inline void get_seed_occurrence_range(const Index *index, uint64_t hash_value, uint64_t *occurrence_start, uint64_t *occurrence_end) {
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_DENSE) {
+    *occurrence_start = index->lookup_table[hash_value];
+    *occurrence_end = index->lookup_table[hash_value + 1];
+  } else if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_SPARSE) {
+    size_t seed_index = find_sparse_seed(index, hash_value);
+    if (seed_index < index->num_distinct_seeds) {
+      *occurrence_start = index->sparse_occurrence_offsets[seed_index];
+      *occurrence_end = index->sparse_occurrence_offsets[seed_index + 1];
+    } else {
+      *occurrence_start = 0;
+      *occurrence_end = 0;
+    }
+  } else {
+    get_elias_fano_value_pair(&(index->succinct_lookup_table), hash_value, occurrence_start, occurrence_end);
+  }
+}
+
+static inline uint32_t get_seed_frequency(const Index *index, uint64_t hash_value) {
+  uint32_t seed_frequency;
+  if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_DENSE) {
+    seed_frequency = index->lookup_table[hash_value + 1] - index->lookup_table[hash_value];
+  } else {
+    uint64_t occurrence_start, occurrence_end;
+    get_seed_occurrence_range(index, hash_value, &occurrence_start, &occurrence_end);
+    seed_frequency = occurrence_end - occurrence_start;
+  }
+  // Repeat buckets are empty in the lookup table.
+  if (seed_frequency == 0 && index->num_repeat_buckets > 0) {
+    uint32_t repeat_bucket = find_repeat_bucket(index, hash_value);
+    if (repeat_bucket < index->num_repeat_buckets) {
+      seed_frequency = index->repeat_lookup_table[repeat_bucket + 1] - index->repeat_lookup_table[repeat_bucket];
+    }
+  }
+  return seed_frequency;
+}
 
-static inline uint32_t get_seed_frequency(const Index *index, uint32_t hash_value) {
-  return index->lookup_table[hash_value + 1] - index->lookup_table[hash_value];
+// Returns the number of occurrences at the start of a bucket of a canonical
+// index that do not have INDEX_OCCURRENCE_REVERSE_STRAND set.
+static inline uint32_t get_num_forward_strand_occurrences(const uint64_t *occurrences, uint32_t num_occurrences) {
+  uint32_t low = 0;
+  uint32_t high = num_occurrences;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (occurrences[middle] & INDEX_OCCURRENCE_REVERSE_STRAND) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
 }
 
-static inline uint64_t* get_seed_occurrences(const Index *index, uint32_t hash_value) {
-  return &(index->occurrence_table[index->lookup_table[hash_value]]);
+// Returns the sorted locations (sequence_index << 32 | position) of a seed.
+// The default occurrence table and the repeat table are used in place, while
+// compact tables are decoded into occurrence_buffer, which is overwritten by
+// the next call. Returns NULL for a repeat whose locations were dropped.
+static inline const uint64_t* get_seed_occurrences(const Index *index, uint64_t hash_value, kvec_t_uint64_t *occurrence_buffer) {
+  if (index->num_repeat_buckets > 0) {
+    uint32_t repeat_bucket = find_repeat_bucket(index, hash_value);
+    if (repeat_bucket < index->num_repeat_buckets) {
+      return index->repeat_occurrence_table == NULL ? NULL : index->repeat_occurrence_table + index->repeat_lookup_table[repeat_bucket];
+    }
+  }
+  if (index->occurrence_table_encoding == INDEX_OCCURRENCE_TABLE_LOCATION) {
+    if (index->lookup_table_encoding == INDEX_LOOKUP_TABLE_DENSE) {
+      return &(index->occurrence_table[index->lookup_table[hash_value]]);
+    }
+    uint64_t occurrence_start, occurrence_end;
+    get_seed_occurrence_range(index, hash_value, &occurrence_start, &occurrence_end);
+    return &(index->occurrence_table[occurrence_start]);
+  }
+  return decode_seed_occurrences(index, hash_value, occurrence_buffer);
 }
 //extern char *index_file_path;
 //extern int max_hash_value;
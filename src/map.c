@@ -2,12 +2,11 @@
 
 void *single_end_read_mapping_thread(void *mapping_args_v) {
   MappingArgs *mapping_args = (MappingArgs*)mapping_args_v;
-  kvec_t_uint64_t candidates;
-  kv_init(candidates.v);
-  kvec_t_uint64_t buffer1;
-  kv_init(buffer1.v);
-  kvec_t_uint64_t buffer2;
-  kv_init(buffer2.v);
+  if (mapping_args->numa_node >= 0) {
+    bind_thread_to_numa_node(mapping_args->numa_node);
+  }
+  MappingWorkspace workspace;
+  initialize_mapping_workspace(&workspace);
   SequenceBatch read_batch;
   initialize_sequence_batch_with_max_size(mapping_args->max_read_batch_size, &read_batch);
   kvec_t_Mapping mappings;
@@ -23,33 +22,45 @@ void *single_end_read_mapping_thread(void *mapping_args_v) {
     }
     double real_start_time = get_real_time();
     mapping_args->mapping_stats.num_reads += read_batch.num_loaded_sequences;
+    // Both strands of a read share its occurrence budget.
+    uint32_t max_num_occurrences = mapping_args->fem_args->max_num_occurrences > 0 ? mapping_args->fem_args->max_num_occurrences : UINT32_MAX;
     // Generate candidates
     for (uint32_t read_index = 0; read_index < read_batch.num_loaded_sequences; ++read_index) {
       kv_clear(mappings.v);
       // Positive strand
       uint32_t num_candidates_without_additonal_qgram_filter = 0;
-      uint32_t num_candidates = generate_group_seeding_candidates(mapping_args->fem_args, &read_batch, read_index, POSITIVE_DIRECTION, mapping_args->reference_sequence_batch, mapping_args->index, &buffer1, &buffer2, &candidates, &num_candidates_without_additonal_qgram_filter);
+      uint32_t num_candidates = generate_group_seeding_candidates(mapping_args->fem_args, &read_batch, read_index, POSITIVE_DIRECTION, mapping_args->reference_sequence_batch, mapping_args->index, max_num_occurrences, &workspace, &num_candidates_without_additonal_qgram_filter);
       mapping_args->mapping_stats.num_candidates_without_additonal_qgram_filter += num_candidates_without_additonal_qgram_filter;
       mapping_args->mapping_stats.num_candidates += num_candidates;
+      if (num_candidates_without_additonal_qgram_filter > max_num_occurrences) {
+        ++(mapping_args->mapping_stats.num_reads_over_occurrence_budget);
+        continue;
+      }
+      uint32_t num_remaining_occurrences = max_num_occurrences - num_candidates_without_additonal_qgram_filter;
       if (num_candidates > 0) {
         // Verify candidates
-        uint32_t num_mappings = verify_candidates(mapping_args->fem_args, &read_batch, read_index, POSITIVE_DIRECTION, mapping_args->reference_sequence_batch, candidates.v.a, num_candidates, &mappings);
+        uint32_t num_mappings = verify_candidates(mapping_args->fem_args, &read_batch, read_index, POSITIVE_DIRECTION, mapping_args->packed_reference, workspace.candidates.v.a, num_candidates, &workspace, &mappings);
         mapping_args->mapping_stats.num_mappings += num_mappings;
       }
       // Negative strand
       prepare_negative_sequence_at(read_index, &read_batch);
       num_candidates_without_additonal_qgram_filter = 0;
-      num_candidates = generate_group_seeding_candidates(mapping_args->fem_args, &read_batch, read_index, NEGATIVE_DIRECTION, mapping_args->reference_sequence_batch, mapping_args->index, &buffer1, &buffer2, &candidates, &num_candidates_without_additonal_qgram_filter);
+      num_candidates = generate_group_seeding_candidates(mapping_args->fem_args, &read_batch, read_index, NEGATIVE_DIRECTION, mapping_args->reference_sequence_batch, mapping_args->index, num_remaining_occurrences, &workspace, &num_candidates_without_additonal_qgram_filter);
       mapping_args->mapping_stats.num_candidates_without_additonal_qgram_filter += num_candidates_without_additonal_qgram_filter;
       mapping_args->mapping_stats.num_candidates += num_candidates;
+      // The read is left unmapped, dropping any mapping of the positive strand.
+      if (num_candidates_without_additonal_qgram_filter > num_remaining_occurrences) {
+        ++(mapping_args->mapping_stats.num_reads_over_occurrence_budget);
+        continue;
+      }
       if (num_candidates > 0) {
         // Verify candidates
-        uint32_t num_mappings = verify_candidates(mapping_args->fem_args, &read_batch, read_index, NEGATIVE_DIRECTION, mapping_args->reference_sequence_batch, candidates.v.a, num_candidates, &mappings);
+        uint32_t num_mappings = verify_candidates(mapping_args->fem_args, &read_batch, read_index, NEGATIVE_DIRECTION, mapping_args->packed_reference, workspace.candidates.v.a, num_candidates, &workspace, &mappings);
         mapping_args->mapping_stats.num_mappings += num_mappings;
       }
       if (kv_size(mappings.v) > 0) {
         ++(mapping_args->mapping_stats.num_mapped_reads);
-        process_mappings(mapping_args->fem_args, &read_batch, read_index, mapping_args->reference_sequence_batch, mappings.v.a, kv_size(mappings.v), &sam_alignment_kvec);
+        process_mappings(mapping_args->fem_args, &read_batch, read_index, mapping_args->packed_reference, mappings.v.a, kv_size(mappings.v), &workspace, &sam_alignment_kvec);
         // Output mappings
         push_output_queue(&sam_alignment_kvec, mapping_args->output_queue);
       }
@@ -62,9 +73,7 @@ void *single_end_read_mapping_thread(void *mapping_args_v) {
   pthread_mutex_unlock(&(mapping_args->output_queue->queue_mutex));
   destory_sequence_batch(&read_batch);
   kv_destroy(sam_alignment_kvec.v);
-  kv_destroy(candidates.v);
-  kv_destroy(buffer1.v);
-  kv_destroy(buffer2.v);
+  destroy_mapping_workspace(&workspace);
   kv_destroy(mappings.v);
   fprintf(stderr, "Thread %d completed.\n", mapping_args->thread_id);
   return NULL;
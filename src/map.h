@@ -5,6 +5,7 @@
 #include "filter.h"
 #include "index.h"
 #include "input_queue.h"
+#include "mapping_workspace.h"
 #include "output_queue.h"
 #include "sequence_batch.h"
 #include "utils.h"
@@ -56,11 +57,13 @@ typedef struct {
   int thread_id;
   uint32_t max_read_batch_size;
   FEMArgs *fem_args;
-  SequenceBatch *reference_sequence_batch;
+  SequenceBatch *reference_sequence_batch; // names and lengths only
+  const PackedReference *packed_reference;
   Index *index;
   InputQueue *input_queue;
   OutputQueue *output_queue;
   MappingStats mapping_stats;
+  int numa_node; // node the thread is bound to, or -1
 } MappingArgs;
 
 void *single_end_read_mapping_thread(void *mapping_args);
@@ -0,0 +1,82 @@
+#include "mapping_workspace.h"
+
+#include "align.h"
+
+void initialize_mapping_workspace(MappingWorkspace *workspace) {
+  memset(workspace, 0, sizeof(MappingWorkspace));
+  kv_init(workspace->seed_frequencies.v);
+  kv_init(workspace->vote_bins.v);
+  kv_init(workspace->vote_counts.v);
+  kv_init(workspace->buffer1.v);
+  kv_init(workspace->buffer2.v);
+  kv_init(workspace->candidates.v);
+  kv_init(workspace->cigar.v);
+}
+
+static void free_per_read_buffers(MappingWorkspace *workspace) {
+  free(workspace->seed_hash_values);
+  free(workspace->seed_orders);
+  free(workspace->seed_is_ambiguous);
+  free(workspace->seed_is_reverse_strand);
+  free(workspace->minimizer_deque);
+  free(workspace->seeds);
+  free(workspace->optimal_seeds);
+  for (int i = 0; i < workspace->num_optimal_seeds && workspace->occurrence_buffers != NULL; ++i) {
+    kv_destroy(workspace->occurrence_buffers[i].v);
+  }
+  free(workspace->occurrence_buffers);
+  free(workspace->dp_occurrences);
+  free(workspace->dp_moves);
+  free(workspace->read_bases);
+  free(workspace->reference_bases);
+  free(workspace->D0s);
+  free(workspace->HPs);
+  free(workspace->cigar_operations);
+  free(workspace->num_cigar_operations);
+}
+
+void destroy_mapping_workspace(MappingWorkspace *workspace) {
+  free_per_read_buffers(workspace);
+  kv_destroy(workspace->seed_frequencies.v);
+  kv_destroy(workspace->vote_bins.v);
+  kv_destroy(workspace->vote_counts.v);
+  kv_destroy(workspace->buffer1.v);
+  kv_destroy(workspace->buffer2.v);
+  kv_destroy(workspace->candidates.v);
+  kv_destroy(workspace->cigar.v);
+  free(workspace->MD_tag.s);
+  memset(workspace, 0, sizeof(MappingWorkspace));
+}
+
+void reserve_mapping_workspace(const FEMArgs *fem_args, int read_length, MappingWorkspace *workspace) {
+  int num_optimal_seeds = fem_args->error_threshold + 1 + fem_args->num_additional_qgrams;
+  if (read_length <= workspace->max_read_length && num_optimal_seeds <= workspace->num_optimal_seeds) {
+    return;
+  }
+  // The buffers hold nothing between reads, so they are replaced rather than copied.
+  free_per_read_buffers(workspace);
+  int max_read_length = 2 * workspace->max_read_length > read_length ? 2 * workspace->max_read_length : read_length;
+  workspace->max_read_length = max_read_length;
+  workspace->num_optimal_seeds = num_optimal_seeds;
+  size_t num_dp_cells = (size_t)(num_optimal_seeds + 1) * (max_read_length + 2);
+  workspace->seed_hash_values = (uint64_t*)malloc(sizeof(uint64_t) * max_read_length);
+  workspace->seed_orders = (uint64_t*)malloc(sizeof(uint64_t) * max_read_length);
+  workspace->seed_is_ambiguous = (uint8_t*)malloc(max_read_length);
+  workspace->seed_is_reverse_strand = (uint8_t*)malloc(max_read_length);
+  workspace->minimizer_deque = (int*)malloc(sizeof(int) * max_read_length);
+  workspace->seeds = (Seed*)malloc(sizeof(Seed) * max_read_length);
+  workspace->optimal_seeds = (Seed*)malloc(sizeof(Seed) * num_optimal_seeds);
+  workspace->occurrence_buffers = (kvec_t_uint64_t*)calloc(num_optimal_seeds, sizeof(kvec_t_uint64_t));
+  workspace->dp_occurrences = (uint32_t*)malloc(sizeof(uint32_t) * num_dp_cells);
+  workspace->dp_moves = (uint8_t*)malloc(num_dp_cells);
+  workspace->read_bases = (uint8_t*)malloc(max_read_length);
+  workspace->reference_bases = (uint8_t*)malloc(NUM_VPU_LANES * (max_read_length + 2 * fem_args->error_threshold));
+  workspace->D0s = (uint32_t*)malloc(sizeof(uint32_t) * max_read_length);
+  workspace->HPs = (uint32_t*)malloc(sizeof(uint32_t) * max_read_length);
+  workspace->cigar_operations = (char*)malloc(max_read_length);
+  workspace->num_cigar_operations = (int*)malloc(sizeof(int) * max_read_length);
+  if (workspace->seed_hash_values == NULL || workspace->seed_orders == NULL || workspace->seed_is_ambiguous == NULL || workspace->seed_is_reverse_strand == NULL || workspace->minimizer_deque == NULL || workspace->seeds == NULL || workspace->optimal_seeds == NULL || workspace->occurrence_buffers == NULL || workspace->dp_occurrences == NULL || workspace->dp_moves == NULL || workspace->read_bases == NULL || workspace->reference_bases == NULL || workspace->D0s == NULL || workspace->HPs == NULL || workspace->cigar_operations == NULL || workspace->num_cigar_operations == NULL) {
+    fprintf(stderr, "Failed to allocate the mapping workspace for reads of %d bases.\n", max_read_length);
+    exit(EXIT_FAILURE);
+  }
+}
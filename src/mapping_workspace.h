@@ -0,0 +1,47 @@
+#ifndef MAPPINGWORKSPACE_H_
+#define MAPPINGWORKSPACE_H_
+
+#include "utils.h"
+
+// Scratch memory of a mapping thread for seeding, verification and
+// alignment. The per-read buffers are sized for max_read_length bases and
+// grown, at least doubling, when a longer read arrives, so reads of any length
+// need no stack space and no allocation once the thread has seen its longest
+// read.
+typedef struct {
+  int max_read_length;
+  int num_optimal_seeds; // error_threshold + 1 + num_additional_qgrams seeds per seed group
+  // Seeding
+  uint64_t *seed_hash_values; // one per seed of the read
+  uint64_t *seed_orders; // minimizer order of each seed
+  uint8_t *seed_is_ambiguous;
+  uint8_t *seed_is_reverse_strand;
+  int *minimizer_deque;
+  Seed *seeds; // of the current seed group
+  Seed *optimal_seeds;
+  uint32_t *dp_occurrences; // (num_optimal_seeds + 1) x (max_read_length + 2) seed selection matrix
+  uint8_t *dp_moves;
+  kvec_t_uint32_t seed_frequencies;
+  kvec_t_uint64_t *occurrence_buffers; // one per optimal seed, for compact occurrence tables
+  kvec_t_uint64_t vote_bins; // diagonal bin table of the voting filter
+  kvec_t_uint32_t vote_counts;
+  kvec_t_uint64_t buffer1;
+  kvec_t_uint64_t buffer2;
+  kvec_t_uint64_t candidates;
+  // Verification and alignment
+  uint8_t *read_bases;
+  uint8_t *reference_bases; // one window of max_read_length + 2e bases per vector lane
+  uint32_t *D0s;
+  uint32_t *HPs;
+  char *cigar_operations;
+  int *num_cigar_operations;
+  kvec_t_uint32_t cigar;
+  kstring_t MD_tag;
+} MappingWorkspace;
+
+void initialize_mapping_workspace(MappingWorkspace *workspace);
+void destroy_mapping_workspace(MappingWorkspace *workspace);
+// Makes the per-read buffers large enough for a read of read_length bases.
+void reserve_mapping_workspace(const FEMArgs *fem_args, int read_length, MappingWorkspace *workspace);
+
+#endif // MAPPINGWORKSPACE_H_
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include "memory_placement.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Reads a list such as "0-3,8,10-11" from a sysfs file and calls add_id on
+// every id in it. Returns 0 if the file cannot be read.
+static int read_id_list(const char *file_path, void (*add_id)(int id, void *ids), void *ids) {
+  FILE *id_list_file = fopen(file_path, "r");
+  if (id_list_file == NULL) {
+    return 0;
+  }
+  char id_list[4096];
+  char *read_result = fgets(id_list, sizeof(id_list), id_list_file);
+  fclose(id_list_file);
+  if (read_result == NULL) {
+    return 0;
+  }
+  char *range = strtok(id_list, ",\n");
+  while (range != NULL) {
+    int first_id = 0, last_id = 0;
+    int num_fields = sscanf(range, "%d-%d", &first_id, &last_id);
+    if (num_fields == 1) {
+      last_id = first_id;
+    }
+    for (int id = first_id; num_fields >= 1 && id <= last_id; ++id) {
+      add_id(id, ids);
+    }
+    range = strtok(NULL, ",\n");
+  }
+  return 1;
+}
+
+static void add_numa_node(int numa_node, void *numa_nodes) {
+  if (numa_node < MEMORY_MAX_NUMA_NODES) {
+    *(uint64_t*)numa_nodes |= ((uint64_t)1) << numa_node;
+  }
+}
+
+static void add_cpu(int cpu, void *cpu_set) {
+  if (cpu < CPU_SETSIZE) {
+    CPU_SET(cpu, (cpu_set_t*)cpu_set);
+  }
+}
+
+static uint64_t get_online_numa_node_mask() {
+  uint64_t numa_node_mask = 0;
+  if (!read_id_list("/sys/devices/system/node/online", add_numa_node, &numa_node_mask) || numa_node_mask == 0) {
+    numa_node_mask = 1; // no NUMA support, everything is on node 0
+  }
+  return numa_node_mask;
+}
+
+int get_online_numa_nodes(int *numa_nodes) {
+  uint64_t numa_node_mask = get_online_numa_node_mask();
+  int num_numa_nodes = 0;
+  for (int numa_node = 0; numa_node < MEMORY_MAX_NUMA_NODES; ++numa_node) {
+    if ((numa_node_mask >> numa_node) & 1) {
+      numa_nodes[num_numa_nodes++] = numa_node;
+    }
+  }
+  return num_numa_nodes;
+}
+
+static size_t get_explicit_huge_page_size() {
+  FILE *meminfo_file = fopen("/proc/meminfo", "r");
+  size_t huge_page_size_in_kb = 0;
+  if (meminfo_file != NULL) {
+    char line[256];
+    while (fgets(line, sizeof(line), meminfo_file) != NULL) {
+      if (sscanf(line, "Hugepagesize: %zu kB", &huge_page_size_in_kb) == 1) {
+        break;
+      }
+    }
+    fclose(meminfo_file);
+  }
+  return huge_page_size_in_kb > 0 ? huge_page_size_in_kb * 1024 : MEMORY_TRANSPARENT_HUGE_PAGE_SIZE;
+}
+
+void *allocate_placed_memory(size_t size, const MemoryPlacement *placement, size_t *allocated_size) {
+  size_t page_size = placement->huge_pages == MEMORY_HUGE_PAGES_EXPLICIT ? get_explicit_huge_page_size() : MEMORY_TRANSPARENT_HUGE_PAGE_SIZE;
+  *allocated_size = (size + page_size - 1) / page_size * page_size;
+  if (*allocated_size == 0) {
+    *allocated_size = page_size;
+  }
+  int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (placement->huge_pages == MEMORY_HUGE_PAGES_EXPLICIT) {
+    mmap_flags |= MAP_HUGETLB;
+  }
+  void *memory = mmap(NULL, *allocated_size, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
+  if (memory == MAP_FAILED) {
+    if (placement->huge_pages == MEMORY_HUGE_PAGES_EXPLICIT) {
+      fprintf(stderr, "Failed to allocate %.2f MB of explicit huge pages, reserve more in /proc/sys/vm/nr_hugepages.\n", *allocated_size / 1048576.0);
+    } else {
+      fprintf(stderr, "Failed to allocate %.2f MB.\n", *allocated_size / 1048576.0);
+    }
+    exit(EXIT_FAILURE);
+  }
+  if (placement->huge_pages == MEMORY_HUGE_PAGES_TRANSPARENT && madvise(memory, *allocated_size, MADV_HUGEPAGE) != 0) {
+    fprintf(stderr, "Warning: transparent huge pages are not available (%s).\n", strerror(errno));
+  }
+  // The policy only applies to pages faulted in later, so it is set before
+  // the caller fills the memory.
+  unsigned long numa_node_mask = 0;
+  int numa_policy = -1;
+  if (placement->numa_node >= 0) {
+    numa_node_mask = ((unsigned long)1) << placement->numa_node;
+    numa_policy = MPOL_BIND;
+  } else if (placement->numa_policy == MEMORY_NUMA_INTERLEAVE) {
+    numa_node_mask = get_online_numa_node_mask();
+    numa_policy = MPOL_INTERLEAVE;
+  }
+  if (numa_policy >= 0 && syscall(SYS_mbind, memory, *allocated_size, numa_policy, &numa_node_mask, MEMORY_MAX_NUMA_NODES + 1, 0) != 0) {
+    fprintf(stderr, "Warning: failed to set the NUMA policy (%s).\n", strerror(errno));
+  }
+  return memory;
+}
+
+void free_placed_memory(void *memory, size_t allocated_size) {
+  munmap(memory, allocated_size);
+}
+
+void bind_thread_to_numa_node(int numa_node) {
+  char cpu_list_file_path[128];
+  snprintf(cpu_list_file_path, sizeof(cpu_list_file_path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (!read_id_list(cpu_list_file_path, add_cpu, &cpu_set) || CPU_COUNT(&cpu_set) == 0) {
+    return;
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0) {
+    fprintf(stderr, "Warning: failed to bind a thread to NUMA node %d (%s).\n", numa_node, strerror(errno));
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef MEMORYPLACEMENT_H_
+#define MEMORYPLACEMENT_H_
+
+#include <stddef.h>
+
+// Page sizes that back the index and the reference in FEM map.
+#define MEMORY_HUGE_PAGES_NONE 0
+#define MEMORY_HUGE_PAGES_TRANSPARENT 1 // madvise(MADV_HUGEPAGE), falls back to small pages
+#define MEMORY_HUGE_PAGES_EXPLICIT 2 // MAP_HUGETLB from the preallocated pool in /proc/sys/vm/nr_hugepages
+#define MEMORY_TRANSPARENT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// How the index and the reference are spread over the NUMA nodes.
+#define MEMORY_NUMA_NONE 0 // first touch
+#define MEMORY_NUMA_INTERLEAVE 1 // pages round-robin over all the nodes
+#define MEMORY_NUMA_REPLICATE 2 // one copy per node, read by the threads bound to that node
+
+#define MEMORY_MAX_NUMA_NODES 64
+
+typedef struct {
+  int huge_pages;
+  int numa_policy;
+  int numa_node; // node a replica is bound to, or -1
+} MemoryPlacement;
+
+static inline void initialize_memory_placement(MemoryPlacement *placement) {
+  placement->huge_pages = MEMORY_HUGE_PAGES_NONE;
+  placement->numa_policy = MEMORY_NUMA_NONE;
+  placement->numa_node = -1;
+}
+
+static inline int is_default_memory_placement(const MemoryPlacement *placement) {
+  return placement->huge_pages == MEMORY_HUGE_PAGES_NONE && placement->numa_policy == MEMORY_NUMA_NONE;
+}
+
+// Fills numa_nodes with the ids of the online nodes and returns how many there are.
+int get_online_numa_nodes(int *numa_nodes);
+// Returns anonymous memory of at least size bytes with the page size and node
+// policy of placement, before any page is touched. *allocated_size is what
+// free_placed_memory needs back.
+void *allocate_placed_memory(size_t size, const MemoryPlacement *placement, size_t *allocated_size);
+void free_placed_memory(void *memory, size_t allocated_size);
+// Restricts the calling thread to the CPUs of numa_node.
+void bind_thread_to_numa_node(int numa_node);
+
+#endif // MEMORYPLACEMENT_H_
@@ -0,0 +1,161 @@
+#include "packed_reference.h"
+
+void initialize_packed_reference(PackedReference *packed_reference) {
+  packed_reference->num_sequences = 0;
+  packed_reference->num_bases = 0;
+  kv_init(packed_reference->sequence_offsets.v);
+  kv_push(uint64_t, packed_reference->sequence_offsets.v, 0);
+  kv_init(packed_reference->names.v);
+  kv_init(packed_reference->packed_bases.v);
+  kv_init(packed_reference->ambiguous_bases.v);
+  packed_reference->is_mapped = 0;
+  packed_reference->placed_words = NULL;
+  packed_reference->placed_words_size = 0;
+}
+
+void destroy_packed_reference(PackedReference *packed_reference) {
+  if (!packed_reference->is_mapped) {
+    kv_destroy(packed_reference->sequence_offsets.v);
+    kv_destroy(packed_reference->names.v);
+    if (packed_reference->placed_words == NULL) {
+      kv_destroy(packed_reference->packed_bases.v);
+      kv_destroy(packed_reference->ambiguous_bases.v);
+    }
+  }
+  if (packed_reference->placed_words != NULL) {
+    free_placed_memory(packed_reference->placed_words, packed_reference->placed_words_size);
+    packed_reference->placed_words = NULL;
+  }
+  kv_init(packed_reference->sequence_offsets.v);
+  kv_init(packed_reference->names.v);
+  kv_init(packed_reference->packed_bases.v);
+  kv_init(packed_reference->ambiguous_bases.v);
+  packed_reference->num_sequences = 0;
+  packed_reference->num_bases = 0;
+  packed_reference->is_mapped = 0;
+}
+
+// Grows the packed and ambiguous bases to num_bases bases, with the new bits
+// cleared.
+static void reserve_packed_bases(uint64_t num_bases, PackedReference *packed_reference) {
+  size_t num_packed_base_words = kv_size(packed_reference->packed_bases.v);
+  size_t num_ambiguous_base_words = kv_size(packed_reference->ambiguous_bases.v);
+  // The capacity at least doubles, so that many short sequences are cheap to append.
+  if (get_num_packed_base_words(num_bases) > packed_reference->packed_bases.v.m) {
+    kv_resize(uint64_t, packed_reference->packed_bases.v, get_num_packed_base_words(num_bases) > 2 * num_packed_base_words ? get_num_packed_base_words(num_bases) : 2 * num_packed_base_words);
+  }
+  if (get_num_ambiguous_base_words(num_bases) > packed_reference->ambiguous_bases.v.m) {
+    kv_resize(uint64_t, packed_reference->ambiguous_bases.v, get_num_ambiguous_base_words(num_bases) > 2 * num_ambiguous_base_words ? get_num_ambiguous_base_words(num_bases) : 2 * num_ambiguous_base_words);
+  }
+  packed_reference->packed_bases.v.n = get_num_packed_base_words(num_bases);
+  packed_reference->ambiguous_bases.v.n = get_num_ambiguous_base_words(num_bases);
+  memset(packed_reference->packed_bases.v.a + num_packed_base_words, 0, sizeof(uint64_t) * (kv_size(packed_reference->packed_bases.v) - num_packed_base_words));
+  memset(packed_reference->ambiguous_bases.v.a + num_ambiguous_base_words, 0, sizeof(uint64_t) * (kv_size(packed_reference->ambiguous_bases.v) - num_ambiguous_base_words));
+}
+
+void append_sequence_to_packed_reference(const char *name, const char *sequence, uint32_t sequence_length, PackedReference *packed_reference) {
+  assert(!packed_reference->is_mapped && packed_reference->placed_words == NULL);
+  for (const char *c = name; *c != '\0'; ++c) {
+    kv_push(char, packed_reference->names.v, *c);
+  }
+  kv_push(char, packed_reference->names.v, '\0');
+  uint64_t offset = packed_reference->num_bases;
+  uint64_t num_bases = offset + sequence_length;
+  reserve_packed_bases(num_bases, packed_reference);
+  for (uint32_t i = 0; i < sequence_length; ++i, ++offset) {
+    uint8_t base = char_to_uint8(sequence[i]);
+    if (base < 4) {
+      kv_A(packed_reference->packed_bases.v, offset / PACKED_REFERENCE_BASES_PER_WORD) |= ((uint64_t)base) << (2 * (offset % PACKED_REFERENCE_BASES_PER_WORD));
+    } else {
+      kv_A(packed_reference->ambiguous_bases.v, offset >> 6) |= ((uint64_t)1) << (offset & 63);
+    }
+  }
+  packed_reference->num_bases = num_bases;
+  ++(packed_reference->num_sequences);
+  kv_push(uint64_t, packed_reference->sequence_offsets.v, num_bases);
+}
+
+// ORs the first num_bits bits of source into cleared words from bit_offset on.
+static void append_bits(const uint64_t *source, uint64_t num_bits, uint64_t bit_offset, uint64_t *words) {
+  uint64_t *destination = words + (bit_offset >> 6);
+  int shift = bit_offset & 63;
+  size_t num_source_words = (num_bits + 63) / 64;
+  for (size_t i = 0; i < num_source_words; ++i) {
+    uint64_t word = source[i];
+    if (i + 1 == num_source_words && (num_bits & 63) != 0) {
+      word &= (((uint64_t)1) << (num_bits & 63)) - 1;
+    }
+    destination[i] |= word << shift;
+    // The carried bits are non-zero only when they fall within num_bits.
+    if (shift > 0 && (word >> (64 - shift)) != 0) {
+      destination[i + 1] |= word >> (64 - shift);
+    }
+  }
+}
+
+void append_packed_reference(const PackedReference *source, PackedReference *packed_reference) {
+  assert(!packed_reference->is_mapped && packed_reference->placed_words == NULL);
+  for (size_t i = 0; i < kv_size(source->names.v); ++i) {
+    kv_push(char, packed_reference->names.v, kv_A(source->names.v, i));
+  }
+  uint64_t offset = packed_reference->num_bases;
+  for (uint32_t sequence_index = 1; sequence_index <= source->num_sequences; ++sequence_index) {
+    kv_push(uint64_t, packed_reference->sequence_offsets.v, offset + kv_A(source->sequence_offsets.v, sequence_index));
+  }
+  reserve_packed_bases(offset + source->num_bases, packed_reference);
+  append_bits(source->packed_bases.v.a, 2 * source->num_bases, 2 * offset, packed_reference->packed_bases.v.a);
+  append_bits(source->ambiguous_bases.v.a, source->num_bases, offset, packed_reference->ambiguous_bases.v.a);
+  packed_reference->num_bases += source->num_bases;
+  packed_reference->num_sequences += source->num_sequences;
+}
+
+void pack_sequence_batch(const SequenceBatch *sequence_batch, PackedReference *packed_reference) {
+  double real_start_time = get_real_time();
+  for (uint32_t sequence_index = 0; sequence_index < sequence_batch->num_loaded_sequences; ++sequence_index) {
+    append_sequence_to_packed_reference(get_sequence_name_from_sequence_batch_at(sequence_batch, sequence_index), get_sequence_from_sequence_batch_at(sequence_batch, sequence_index), get_sequence_length_from_sequence_batch_at(sequence_batch, sequence_index), packed_reference);
+  }
+  fprintf(stderr, "Packed %"PRIu64" bases of %d sequences in %fs.\n", packed_reference->num_bases, packed_reference->num_sequences, get_real_time() - real_start_time);
+}
+
+void place_packed_reference(const MemoryPlacement *placement, PackedReference *packed_reference) {
+  assert(packed_reference->placed_words == NULL);
+  double real_start_time = get_real_time();
+  size_t num_packed_base_words = kv_size(packed_reference->packed_bases.v);
+  size_t num_ambiguous_base_words = kv_size(packed_reference->ambiguous_bases.v);
+  packed_reference->placed_words = (uint64_t*)allocate_placed_memory(sizeof(uint64_t) * (num_packed_base_words + num_ambiguous_base_words), placement, &(packed_reference->placed_words_size));
+  memcpy(packed_reference->placed_words, packed_reference->packed_bases.v.a, sizeof(uint64_t) * num_packed_base_words);
+  memcpy(packed_reference->placed_words + num_packed_base_words, packed_reference->ambiguous_bases.v.a, sizeof(uint64_t) * num_ambiguous_base_words);
+  if (!packed_reference->is_mapped) {
+    kv_destroy(packed_reference->packed_bases.v);
+    kv_destroy(packed_reference->ambiguous_bases.v);
+  }
+  packed_reference->packed_bases.v.a = packed_reference->placed_words;
+  packed_reference->packed_bases.v.m = num_packed_base_words;
+  packed_reference->ambiguous_bases.v.a = packed_reference->placed_words + num_packed_base_words;
+  packed_reference->ambiguous_bases.v.m = num_ambiguous_base_words;
+  fprintf(stderr, "Placed %.2f MB of packed reference in %fs\n", packed_reference->placed_words_size / 1048576.0, get_real_time() - real_start_time);
+}
+
+void load_sequence_names_from_packed_reference(const PackedReference *packed_reference, SequenceBatch *sequence_batch) {
+  sequence_batch->num_loaded_sequences = packed_reference->num_sequences;
+  sequence_batch->max_num_sequences = packed_reference->num_sequences;
+  sequence_batch->num_bases = packed_reference->num_bases;
+  const char *name = packed_reference->names.v.a;
+  for (uint32_t sequence_index = 0; sequence_index < packed_reference->num_sequences; ++sequence_index) {
+    kseq_t *sequence = (kseq_t*)calloc(1, sizeof(kseq_t));
+    assert(sequence);
+    sequence->name.l = strlen(name);
+    sequence->name.m = sequence->name.l + 1;
+    sequence->name.s = strdup(name);
+    assert(sequence->name.s);
+    name += sequence->name.l + 1;
+    sequence->seq.l = kv_A(packed_reference->sequence_offsets.v, sequence_index + 1) - kv_A(packed_reference->sequence_offsets.v, sequence_index);
+    kv_push(kseq_t*, sequence_batch->sequences, sequence);
+  }
+  kv_resize(kvec_t_char, sequence_batch->negative_sequences, sequence_batch->max_num_sequences);
+  for (uint32_t i = 0; i < sequence_batch->max_num_sequences; ++i) {
+    kv_init(kv_A(sequence_batch->negative_sequences, i).v);
+  }
+  fprintf(stderr, "Number of sequences: %d\n", sequence_batch->num_loaded_sequences);
+  fprintf(stderr, "Number of bases: %"PRIu64"\n", sequence_batch->num_bases);
+}
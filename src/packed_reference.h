@@ -0,0 +1,107 @@
+#ifndef PACKEDREFERENCE_H_
+#define PACKEDREFERENCE_H_
+
+#include "memory_placement.h"
+#include "sequence_batch.h"
+#include "utils.h"
+
+// The reference sequences concatenated without separators, with 2 bits per
+// base, 32 bases per word starting from the low bits, and one bit per base
+// marking the ambiguous bases, which are packed as A.
+#define PACKED_REFERENCE_BASES_PER_WORD 32
+
+typedef struct {
+  uint32_t num_sequences;
+  uint64_t num_bases;
+  kvec_t_uint64_t sequence_offsets; // offset of each sequence, num_sequences + 1 entries
+  kvec_t_char names; // NUL-terminated names, one after another
+  kvec_t_uint64_t packed_bases;
+  kvec_t_uint64_t ambiguous_bases;
+  int is_mapped; // the vectors point into a mapped index file and are not freed
+  uint64_t *placed_words; // non-NULL when the packed and ambiguous bases were moved into placed memory
+  size_t placed_words_size;
+} PackedReference;
+
+static inline size_t get_num_packed_base_words(uint64_t num_bases) {
+  return (num_bases + PACKED_REFERENCE_BASES_PER_WORD - 1) / PACKED_REFERENCE_BASES_PER_WORD;
+}
+
+static inline size_t get_num_ambiguous_base_words(uint64_t num_bases) {
+  return (num_bases + 63) / 64;
+}
+
+// Returns the 2-bit code of the base at an offset into the concatenated
+// reference, or 4 for an ambiguous base.
+static inline uint8_t get_packed_base(const PackedReference *packed_reference, uint64_t offset) {
+  if ((kv_A(packed_reference->ambiguous_bases.v, offset >> 6) >> (offset & 63)) & 1) {
+    return 4;
+  }
+  return (kv_A(packed_reference->packed_bases.v, offset / PACKED_REFERENCE_BASES_PER_WORD) >> (2 * (offset % PACKED_REFERENCE_BASES_PER_WORD))) & 3;
+}
+
+// Spreads the 8 2-bit codes in the low 16 bits of packed_bases to one code
+// per byte, first base in the lowest byte.
+static inline uint64_t spread_packed_bases(uint64_t packed_bases) {
+  uint64_t bases = packed_bases & 0xffff;
+  bases = (bases | (bases << 24)) & 0x000000ff000000ffULL;
+  bases = (bases | (bases << 12)) & 0x000f000f000f000fULL;
+  bases = (bases | (bases << 6)) & 0x0303030303030303ULL;
+  return bases;
+}
+
+// Decodes num_bases bases starting at an offset into the concatenated
+// reference into 2-bit codes, with 4 for the ambiguous bases. 32 bases are
+// gathered from at most two packed words and expanded 8 at a time.
+static inline void decode_packed_reference(const PackedReference *packed_reference, uint64_t offset, uint32_t num_bases, uint8_t *bases) {
+  const uint64_t *packed_bases = packed_reference->packed_bases.v.a;
+  size_t num_packed_base_words = get_num_packed_base_words(packed_reference->num_bases);
+  uint32_t base_index = 0;
+  while (base_index < num_bases) {
+    uint64_t base_offset = offset + base_index;
+    size_t word_index = base_offset / PACKED_REFERENCE_BASES_PER_WORD;
+    int shift = 2 * (base_offset % PACKED_REFERENCE_BASES_PER_WORD);
+    uint64_t packed_word = packed_bases[word_index] >> shift;
+    if (shift > 0 && word_index + 1 < num_packed_base_words) {
+      packed_word |= packed_bases[word_index + 1] << (64 - shift);
+    }
+    if (num_bases - base_index >= PACKED_REFERENCE_BASES_PER_WORD) {
+      for (int i = 0; i < 4; ++i) {
+        uint64_t spread_bases = spread_packed_bases(packed_word >> (16 * i));
+        memcpy(bases + base_index + 8 * i, &spread_bases, sizeof(uint64_t));
+      }
+      base_index += PACKED_REFERENCE_BASES_PER_WORD;
+    } else {
+      for (; base_index < num_bases; ++base_index) {
+        bases[base_index] = packed_word & 3;
+        packed_word >>= 2;
+      }
+    }
+  }
+  // Most windows have no ambiguous base, so a zero word is skipped at once.
+  const uint64_t *ambiguous_bases = packed_reference->ambiguous_bases.v.a;
+  for (uint64_t word_index = offset >> 6; word_index <= (offset + num_bases - 1) >> 6 && num_bases > 0; ++word_index) {
+    uint64_t ambiguous_word = ambiguous_bases[word_index];
+    while (ambiguous_word != 0) {
+      uint64_t base_offset = (word_index << 6) + __builtin_ctzll(ambiguous_word);
+      if (base_offset >= offset && base_offset < offset + num_bases) {
+        bases[base_offset - offset] = 4;
+      }
+      ambiguous_word &= ambiguous_word - 1;
+    }
+  }
+}
+
+void initialize_packed_reference(PackedReference *packed_reference);
+void destroy_packed_reference(PackedReference *packed_reference);
+void append_sequence_to_packed_reference(const char *name, const char *sequence, uint32_t sequence_length, PackedReference *packed_reference);
+// Appends all the sequences of source after those of packed_reference.
+void append_packed_reference(const PackedReference *source, PackedReference *packed_reference);
+void pack_sequence_batch(const SequenceBatch *sequence_batch, PackedReference *packed_reference);
+// Moves the packed and ambiguous bases into one block of placed memory. The
+// reference must not be appended to afterwards.
+void place_packed_reference(const MemoryPlacement *placement, PackedReference *packed_reference);
+// Fills a batch initialized with initialize_sequence_batch with the names and
+// lengths of the sequences but not their bases, which stay packed.
+void load_sequence_names_from_packed_reference(const PackedReference *packed_reference, SequenceBatch *sequence_batch);
+
+#endif // PACKEDREFERENCE_H_
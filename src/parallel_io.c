@@ -0,0 +1,151 @@
+#define _GNU_SOURCE
+#include "parallel_io.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  const ParallelFile *file;
+  uint8_t *memory;
+  size_t size;
+  uint64_t offset;
+  int is_write;
+  size_t *next_chunk;
+  int *has_failed;
+} ParallelIOArgs;
+
+// Opens the O_DIRECT descriptor next to the buffered one. File systems such as
+// tmpfs reject O_DIRECT, in which case all the chunks go through the page cache.
+static void open_direct_fd(const char *file_path, int flags, int direct_io, ParallelFile *file) {
+  file->direct_fd = -1;
+  if (!direct_io) {
+    return;
+  }
+  file->direct_fd = open(file_path, flags | O_DIRECT);
+  if (file->direct_fd < 0) {
+    fprintf(stderr, "Warning: O_DIRECT is not available for %s (%s), using buffered I/O.\n", file_path, strerror(errno));
+  }
+}
+
+int open_parallel_file_for_reading(const char *file_path, int num_threads, int direct_io, ParallelFile *file) {
+  file->num_threads = num_threads > 0 ? num_threads : 1;
+  file->fd = open(file_path, O_RDONLY);
+  if (file->fd < 0) {
+    return 0;
+  }
+  open_direct_fd(file_path, O_RDONLY, direct_io, file);
+  return 1;
+}
+
+int open_parallel_file_for_writing(const char *file_path, int num_threads, int direct_io, ParallelFile *file) {
+  file->num_threads = num_threads > 0 ? num_threads : 1;
+  file->fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file->fd < 0) {
+    return 0;
+  }
+  open_direct_fd(file_path, O_WRONLY, direct_io, file);
+  return 1;
+}
+
+int close_parallel_file(ParallelFile *file) {
+  int is_closed = 1;
+  if (file->direct_fd >= 0) {
+    is_closed = close(file->direct_fd) == 0;
+    file->direct_fd = -1;
+  }
+  is_closed = close(file->fd) == 0 && is_closed;
+  file->fd = -1;
+  return is_closed;
+}
+
+static int transfer_chunk(int fd, uint8_t *memory, size_t size, uint64_t offset, int is_write) {
+  size_t num_transferred_bytes = 0;
+  while (num_transferred_bytes < size) {
+    ssize_t result = is_write ? pwrite(fd, memory + num_transferred_bytes, size - num_transferred_bytes, offset + num_transferred_bytes) : pread(fd, memory + num_transferred_bytes, size - num_transferred_bytes, offset + num_transferred_bytes);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return 0;
+    }
+    num_transferred_bytes += result;
+  }
+  return 1;
+}
+
+static void *parallel_io_thread(void *parallel_io_args_v) {
+  ParallelIOArgs *args = (ParallelIOArgs*)parallel_io_args_v;
+  const ParallelFile *file = args->file;
+  uint8_t *bounce_buffer = NULL;
+  while (!*(args->has_failed)) {
+    size_t chunk_start = __sync_fetch_and_add(args->next_chunk, 1) * (size_t)PARALLEL_IO_CHUNK_SIZE;
+    if (chunk_start >= args->size) {
+      break;
+    }
+    size_t chunk_size = args->size - chunk_start < PARALLEL_IO_CHUNK_SIZE ? args->size - chunk_start : PARALLEL_IO_CHUNK_SIZE;
+    uint8_t *chunk = args->memory + chunk_start;
+    uint64_t chunk_offset = args->offset + chunk_start;
+    int fd = file->fd;
+    uint8_t *transfer_buffer = chunk;
+    // An aligned range of the file goes through O_DIRECT, from an aligned
+    // copy when the caller's memory is not aligned.
+    if (file->direct_fd >= 0 && (chunk_offset | chunk_size) % PARALLEL_IO_DIRECT_ALIGNMENT == 0) {
+      fd = file->direct_fd;
+      if ((uintptr_t)chunk % PARALLEL_IO_DIRECT_ALIGNMENT != 0) {
+        if (bounce_buffer == NULL && posix_memalign((void**)&bounce_buffer, PARALLEL_IO_DIRECT_ALIGNMENT, PARALLEL_IO_CHUNK_SIZE) != 0) {
+          fprintf(stderr, "Failed to allocate an aligned I/O buffer.\n");
+          exit(EXIT_FAILURE);
+        }
+        transfer_buffer = bounce_buffer;
+        if (args->is_write) {
+          memcpy(transfer_buffer, chunk, chunk_size);
+        }
+      }
+    }
+    if (!transfer_chunk(fd, transfer_buffer, chunk_size, chunk_offset, args->is_write)) {
+      *(args->has_failed) = 1;
+      break;
+    }
+    if (!args->is_write && transfer_buffer != chunk) {
+      memcpy(chunk, transfer_buffer, chunk_size);
+    }
+  }
+  free(bounce_buffer);
+  return NULL;
+}
+
+static int transfer_parallel_file(const ParallelFile *file, uint8_t *memory, size_t size, uint64_t offset, int is_write) {
+  size_t num_chunks = (size + PARALLEL_IO_CHUNK_SIZE - 1) / PARALLEL_IO_CHUNK_SIZE;
+  int num_threads = (size_t)file->num_threads < num_chunks ? file->num_threads : (int)num_chunks;
+  size_t next_chunk = 0;
+  int has_failed = 0;
+  ParallelIOArgs args = {file, memory, size, offset, is_write, &next_chunk, &has_failed};
+  if (num_threads <= 1) {
+    parallel_io_thread(&args);
+    return !has_failed;
+  }
+  pthread_t io_thread_handles[num_threads];
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_create(io_thread_handles + i, NULL, parallel_io_thread, &args);
+    assert(pthread_err == 0);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    int pthread_err = pthread_join(io_thread_handles[i], NULL);
+    assert(pthread_err == 0);
+  }
+  return !has_failed;
+}
+
+int read_parallel_file(const ParallelFile *file, void *memory, size_t size, uint64_t offset) {
+  return transfer_parallel_file(file, (uint8_t*)memory, size, offset, 0);
+}
+
+int write_parallel_file(const ParallelFile *file, const void *memory, size_t size, uint64_t offset) {
+  return transfer_parallel_file(file, (uint8_t*)memory, size, offset, 1);
+}
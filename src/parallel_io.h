@@ -0,0 +1,31 @@
+#ifndef PARALLELIO_H_
+#define PARALLELIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Large transfers are split into chunks that the threads take in turn, each
+// with its own pread or pwrite at the chunk's offset.
+#define PARALLEL_IO_CHUNK_SIZE (16 * 1024 * 1024)
+// Buffer address, file offset and length of an O_DIRECT transfer must all be
+// multiples of this.
+#define PARALLEL_IO_DIRECT_ALIGNMENT 4096
+
+// A file opened twice, once with O_DIRECT when it was asked for and the file
+// system supports it. Chunks that are not aligned use the buffered descriptor.
+typedef struct {
+  int fd;
+  int direct_fd; // -1 without O_DIRECT
+  int num_threads;
+} ParallelFile;
+
+// Return 0 if the file cannot be opened.
+int open_parallel_file_for_reading(const char *file_path, int num_threads, int direct_io, ParallelFile *file);
+int open_parallel_file_for_writing(const char *file_path, int num_threads, int direct_io, ParallelFile *file);
+// Returns 0 if closing reports a deferred write error.
+int close_parallel_file(ParallelFile *file);
+// Return 0 on an I/O error or when the file ends before size bytes.
+int read_parallel_file(const ParallelFile *file, void *memory, size_t size, uint64_t offset);
+int write_parallel_file(const ParallelFile *file, const void *memory, size_t size, uint64_t offset);
+
+#endif // PARALLELIO_H_
@@ -120,6 +120,17 @@ void load_all_sequences_into_sequence_batch(SequenceBatch *sequence_batch) {
   fprintf(stderr, "Loaded all sequences successfully in %fs\n", get_real_time() - real_start_time);
 }
 
+// Frees the bases of all the loaded sequences and keeps their names and
+// lengths. The sequences must not be reloaded afterwards.
+void release_sequence_bases_in_sequence_batch(SequenceBatch *sequence_batch) {
+  for (uint32_t sequence_index = 0; sequence_index < sequence_batch->num_loaded_sequences; ++sequence_index) {
+    kseq_t *sequence = kv_A(sequence_batch->sequences, sequence_index);
+    free(sequence->seq.s);
+    sequence->seq.s = NULL;
+    sequence->seq.m = 0;
+  }
+}
+
 //bool LoadOneSequenceAndSaveAt(uint32_t sequence_index) {
 //  //double real_start_time = Chromap::GetRealTime();
 //  bool no_more_sequence = false;
@@ -73,6 +73,7 @@ void initialize_sequence_batch_with_max_size(uint32_t max_num_sequences, Sequenc
 void destory_sequence_batch(SequenceBatch *sequence_batch);
 void load_batch_of_sequences_into_sequence_batch(SequenceBatch *sequence_batch);
 void load_all_sequences_into_sequence_batch(SequenceBatch *sequence_batch);
+void release_sequence_bases_in_sequence_batch(SequenceBatch *sequence_batch);
 
 //bool LoadOneSequenceAndSaveAt(uint32_t sequence_index);
 
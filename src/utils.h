@@ -58,6 +58,7 @@ typedef struct {
   uint64_t num_candidates_without_additonal_qgram_filter;
   uint64_t num_candidates;
   uint64_t num_mappings;
+  uint64_t num_reads_over_occurrence_budget; // left unmapped, see FEMArgs.max_num_occurrences
 } MappingStats;
 
 typedef struct {
@@ -67,6 +68,9 @@ typedef struct {
   int num_additional_qgrams;
   int num_threads;
   char seeding_method; // "v" for variable length seeding, "g" for group seeding.
+  int repeat_policy; // what to do with seed groups that need a repeat, see index.h
+  int filter_engine; // how seed group candidates are gathered, see filter.h
+  uint32_t max_num_occurrences; // occurrences of the optimal seeds a read may use, 0 for no limit
 } FEMArgs;
 
 static const uint8_t char_to_uint8_table[256] = {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4};
@@ -80,9 +84,44 @@ static inline char uint8_to_char(uint8_t i) {
   return uint8_to_char_table[i];
 }
 
-static inline uint32_t hash_seed_in_sequence(size_t seed_start_position, int seed_length, const char *sequence, size_t sequence_length) {
-  uint32_t mask = (((uint32_t)1) << (2 * seed_length)) - 1;
-  uint32_t hash_value = 0;
+// Seeds are hashed to their 2-bit codes, which take 64 bits for k up to 32.
+static inline uint64_t get_seed_mask(int seed_length) {
+  return seed_length >= 32 ? ~((uint64_t)0) : (((uint64_t)1) << (2 * seed_length)) - 1;
+}
+
+// Returns the code of the reverse complement of a seed. The complement of a
+// base is 3 minus its code, so the bases are complemented all at once and then
+// put in reverse order.
+static inline uint64_t reverse_complement_seed(uint64_t hash_value, int seed_length) {
+  uint64_t reverse_complement = ~hash_value;
+  reverse_complement = ((reverse_complement >> 2) & 0x3333333333333333ULL) | ((reverse_complement & 0x3333333333333333ULL) << 2);
+  reverse_complement = ((reverse_complement >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((reverse_complement & 0x0f0f0f0f0f0f0f0fULL) << 4);
+  return __builtin_bswap64(reverse_complement) >> (64 - 2 * seed_length);
+}
+
+// A seed and its reverse complement share the smaller of their two codes.
+static inline uint64_t get_canonical_seed(uint64_t hash_value, int seed_length) {
+  uint64_t reverse_complement = reverse_complement_seed(hash_value, seed_length);
+  return reverse_complement < hash_value ? reverse_complement : hash_value;
+}
+
+// The order in which (w,k)-minimizers are chosen: an invertible mix of the
+// 2k-bit code, so that low-complexity k-mers such as poly-A are not favored.
+static inline uint64_t get_minimizer_order(uint64_t hash_value, int seed_length) {
+  uint64_t mask = get_seed_mask(seed_length);
+  uint64_t order = (~hash_value + (hash_value << 21)) & mask;
+  order = order ^ order >> 24;
+  order = ((order + (order << 3)) + (order << 8)) & mask;
+  order = order ^ order >> 14;
+  order = ((order + (order << 2)) + (order << 4)) & mask;
+  order = order ^ order >> 28;
+  order = (order + (order << 31)) & mask;
+  return order;
+}
+
+static inline uint64_t hash_seed_in_sequence(size_t seed_start_position, int seed_length, const char *sequence, size_t sequence_length) {
+  uint64_t mask = get_seed_mask(seed_length);
+  uint64_t hash_value = 0;
   for (uint32_t i = 0; i < seed_length; ++i) {
     if (seed_start_position + i < sequence_length) {
       uint8_t current_base = char_to_uint8(sequence[i + seed_start_position]);
@@ -98,11 +137,11 @@ static inline uint32_t hash_seed_in_sequence(size_t seed_start_position, int see
   return hash_value;
 }
 
-static inline void hash_all_seeds_in_sequence(size_t seed_start_position, size_t seed_end_position, int seed_length, const char *sequence, size_t sequence_length, int *num_seeds_with_ambiguous_base, uint32_t *seed_hash_values) {
+static inline void hash_all_seeds_in_sequence(size_t seed_start_position, size_t seed_end_position, int seed_length, const char *sequence, size_t sequence_length, int *num_seeds_with_ambiguous_base, uint64_t *seed_hash_values) {
   assert(seed_end_position <= sequence_length);
   *num_seeds_with_ambiguous_base = 0;
-  uint32_t mask = (((uint32_t)1) << (2 * seed_length)) - 1;
-  uint32_t hash_value = hash_seed_in_sequence(seed_start_position, seed_length, sequence, sequence_length);
+  uint64_t mask = get_seed_mask(seed_length);
+  uint64_t hash_value = hash_seed_in_sequence(seed_start_position, seed_length, sequence, sequence_length);
   seed_hash_values[0] = hash_value;
   for (size_t i = seed_start_position + 1; i < seed_end_position; ++i) {
     uint8_t current_base = char_to_uint8(sequence[i + seed_length - 1]);
@@ -116,11 +155,35 @@ static inline void hash_all_seeds_in_sequence(size_t seed_start_position, size_t
   }
 }
 
+static inline int seed_has_ambiguous_base(size_t seed_start_position, int seed_length, const char *sequence) {
+  for (int i = 0; i < seed_length; ++i) {
+    if (char_to_uint8(sequence[seed_start_position + i]) > 3) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Marks the seeds at positions [0, num_seeds) that overlap an ambiguous base.
+static inline void mark_seeds_with_ambiguous_base(size_t num_seeds, int seed_length, const char *sequence, uint8_t *seed_is_ambiguous) {
+  int64_t last_ambiguous_position = -1;
+  for (size_t position = 0; position < num_seeds + seed_length - 1; ++position) {
+    if (char_to_uint8(sequence[position]) > 3) {
+      last_ambiguous_position = position;
+    }
+    if (position + 1 >= (size_t)seed_length) {
+      size_t seed_position = position + 1 - seed_length;
+      seed_is_ambiguous[seed_position] = last_ambiguous_position >= (int64_t)seed_position;
+    }
+  }
+}
+
 typedef struct {
-  uint32_t hash_value;
+  uint64_t hash_value;
   uint32_t start_position;
   uint32_t end_position;
   uint32_t num_positions;
+  uint8_t is_reverse_strand; // in a canonical index, the seed is the reverse complement of its bucket's k-mer
 } Seed;
 
 static inline int compare_seed(const void *ta, const void *tb) {